@@ -61,8 +61,14 @@ struct priv {
 
     AVRational worst_time_base;
     int worst_time_base_is_stream;
+
+    // runs encode_job(); NULL if encoding is synchronous
+    struct encode_lavc_worker *worker;
 };
 
+// Number of frames that can be queued for the encoder thread.
+#define ENCODE_QUEUE_SIZE 16
+
 // open & setup audio device
 static int init(struct ao *ao)
 {
@@ -274,6 +280,9 @@ out_takefirst:
                  encode_lavc_getoffset(ao->encode_lavc_ctx, ac->stream);
     ac->offset_left = ac->offset;
 
+    ac->worker = encode_lavc_worker_create(ao->encode_lavc_ctx, ac,
+                                           ENCODE_QUEUE_SIZE);
+
     ao->untimed = true;
     ao->priv = ac;
 
@@ -295,7 +304,7 @@ static void fill_with_padding(void *buf, int cnt, int sz, const void *padding)
 }
 
 // close audio device
-static int encode(struct ao *ao, double apts, void *data);
+static void encode(struct ao *ao, double apts, void *data);
 static int play(struct ao *ao, void *data, int len, int flags);
 static void uninit(struct ao *ao, bool cut_audio)
 {
@@ -331,9 +340,12 @@ static void uninit(struct ao *ao, bool cut_audio)
             outpts += ectx->discontinuity_pts_offset;
         outpts += encode_lavc_getoffset(ectx, ac->stream);
 
-        while (encode(ao, outpts, NULL) > 0) ;
+        encode(ao, outpts, NULL);
     }
 
+    encode_lavc_worker_wait(ac->worker);
+    talloc_free(ac->worker);
+
     ao->priv = NULL;
 }
 
@@ -345,66 +357,44 @@ static int get_space(struct ao *ao)
     return ac->aframesize * ac->sample_size * ao->channels.num * ac->framecount;
 }
 
-// must get exactly ac->aframesize amount of data
-static int encode(struct ao *ao, double apts, void *data)
+struct encode_job {
+    struct ao *ao;
+    void *data;         // aframesize samples; NULL: flush the encoder
+    int64_t pts;        // in codec time base
+    double apts, realapts;
+};
+
+// Encode one frame, or flush the encoder, and write the resulting packet.
+// Runs on the encoder thread if there is a worker. ac->buffer, ac->savepts and
+// the codec context are only accessed from here after init.
+// return: size of the packet written, 0 if none, or -1 on error
+static int encode_frame(struct encode_job *job)
 {
+    struct ao *ao = job->ao;
+    struct priv *ac = ao->priv;
     AVFrame *frame;
     AVPacket packet;
-    struct priv *ac = ao->priv;
-    struct encode_lavc_context *ectx = ao->encode_lavc_ctx;
-    double realapts = ac->aframecount * (double) ac->aframesize /
-                      ao->samplerate;
     int status, gotpacket;
 
-    ac->aframecount++;
-
-    if (data)
-        ectx->audio_pts_offset = realapts - apts;
-
     av_init_packet(&packet);
     packet.data = ac->buffer;
     packet.size = ac->buffer_size;
-    if(data)
+    if(job->data)
     {
         frame = avcodec_alloc_frame();
         frame->nb_samples = ac->aframesize;
 
-        if (ac->planarize) {
-            void *data2 = talloc_size(ao, ac->aframesize * ao->channels.num *
-                                      ac->sample_size);
-            reorder_to_planar(data2, data, ac->sample_size, ao->channels.num,
-                              ac->aframesize);
-            data = data2;
-        }
-
         size_t audiolen = ac->aframesize * ao->channels.num * ac->sample_size;
         if (avcodec_fill_audio_frame(frame, ao->channels.num,
-                                     ac->stream->codec->sample_fmt, data,
+                                     ac->stream->codec->sample_fmt, job->data,
                                      audiolen, 1))
         {
             MP_ERR(ao, "error filling\n");
+            avcodec_free_frame(&frame);
             return -1;
         }
 
-        if (ectx->options->rawts || ectx->options->copyts) {
-            // real audio pts
-            frame->pts = floor(apts * ac->stream->codec->time_base.den / ac->stream->codec->time_base.num + 0.5);
-        } else {
-            // audio playback time
-            frame->pts = floor(realapts * ac->stream->codec->time_base.den / ac->stream->codec->time_base.num + 0.5);
-        }
-
-        int64_t frame_pts = av_rescale_q(frame->pts, ac->stream->codec->time_base, ac->worst_time_base);
-        if (ac->lastpts != MP_NOPTS_VALUE && frame_pts <= ac->lastpts) {
-            // this indicates broken video
-            // (video pts failing to increase fast enough to match audio)
-            MP_WARN(ao, "audio frame pts went backwards (%d <- %d), autofixed\n",
-                    (int)frame->pts, (int)ac->lastpts);
-            frame_pts = ac->lastpts + 1;
-            frame->pts = av_rescale_q(frame_pts, ac->worst_time_base, ac->stream->codec->time_base);
-        }
-        ac->lastpts = frame_pts;
-
+        frame->pts = job->pts;
         frame->quality = ac->stream->codec->global_quality;
         status = avcodec_encode_audio2(ac->stream->codec, &packet, frame, &gotpacket);
 
@@ -414,11 +404,6 @@ static int encode(struct ao *ao, double apts, void *data)
         }
 
         avcodec_free_frame(&frame);
-
-        if (ac->planarize) {
-            talloc_free(data);
-            data = NULL;
-        }
     }
     else
     {
@@ -434,7 +419,7 @@ static int encode(struct ao *ao, double apts, void *data)
         return 0;
 
     MP_DBG(ao, "got pts %f (playback time: %f); out size: %d\n",
-           apts, realapts, packet.size);
+           job->apts, job->realapts, packet.size);
 
     encode_lavc_write_stats(ao->encode_lavc_ctx, ac->stream);
 
@@ -463,7 +448,7 @@ static int encode(struct ao *ao, double apts, void *data)
 
     if (encode_lavc_write_frame(ao->encode_lavc_ctx, &packet) < 0) {
         MP_ERR(ao, "error writing at %f %f/%f\n",
-               realapts, (double) ac->stream->time_base.num,
+               job->realapts, (double) ac->stream->time_base.num,
                (double) ac->stream->time_base.den);
         return -1;
     }
@@ -471,6 +456,74 @@ static int encode(struct ao *ao, double apts, void *data)
     return packet.size;
 }
 
+static void encode_job(void *ptr)
+{
+    struct encode_job *job = ptr;
+    if (job->data) {
+        encode_frame(job);
+    } else {
+        while (encode_frame(job) > 0) ;
+    }
+    talloc_free(job);
+}
+
+// must get exactly ac->aframesize amount of data
+// data==NULL flushes the encoder
+static void encode(struct ao *ao, double apts, void *data)
+{
+    struct priv *ac = ao->priv;
+    struct encode_lavc_context *ectx = ao->encode_lavc_ctx;
+    double realapts = ac->aframecount * (double) ac->aframesize /
+                      ao->samplerate;
+
+    ac->aframecount++;
+
+    struct encode_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct encode_job) {
+        .ao = ao,
+        .pts = AV_NOPTS_VALUE,
+        .apts = apts,
+        .realapts = realapts,
+    };
+
+    if(data)
+    {
+        ectx->audio_pts_offset = realapts - apts;
+
+        // copy the samples, as the caller reuses its buffer
+        size_t audiolen = ac->aframesize * ao->channels.num * ac->sample_size;
+        job->data = talloc_size(job, audiolen);
+        if (ac->planarize) {
+            reorder_to_planar(job->data, data, ac->sample_size, ao->channels.num,
+                              ac->aframesize);
+        } else {
+            memcpy(job->data, data, audiolen);
+        }
+
+        AVRational time_base = ac->stream->codec->time_base;
+        if (ectx->options->rawts || ectx->options->copyts) {
+            // real audio pts
+            job->pts = floor(apts * time_base.den / time_base.num + 0.5);
+        } else {
+            // audio playback time
+            job->pts = floor(realapts * time_base.den / time_base.num + 0.5);
+        }
+
+        int64_t frame_pts = av_rescale_q(job->pts, time_base, ac->worst_time_base);
+        if (ac->lastpts != MP_NOPTS_VALUE && frame_pts <= ac->lastpts) {
+            // this indicates broken video
+            // (video pts failing to increase fast enough to match audio)
+            MP_WARN(ao, "audio frame pts went backwards (%d <- %d), autofixed\n",
+                    (int)job->pts, (int)ac->lastpts);
+            frame_pts = ac->lastpts + 1;
+            job->pts = av_rescale_q(frame_pts, ac->worst_time_base, time_base);
+        }
+        ac->lastpts = frame_pts;
+    }
+
+    encode_lavc_worker_queue(ac->worker, encode_job, job);
+}
+
 // plays 'len' bytes of 'data'
 // it should round it down to frame sizes
 // return: number of bytes played
@@ -136,6 +136,7 @@ static struct demux_packet *create_packet(size_t len)
     *dp = (struct demux_packet) {
         .len = len,
         .pts = MP_NOPTS_VALUE,
+        .dts = MP_NOPTS_VALUE,
         .duration = -1,
         .stream_pts = MP_NOPTS_VALUE,
     };
@@ -188,6 +189,56 @@ void resize_demux_packet(struct demux_packet *dp, size_t len)
     dp->allocation = dp->buffer;
 }
 
+// Data shared by a packet and the slices created from it.
+struct demux_packet_shared {
+    void *allocation;
+    int refcount;
+};
+
+static int unref_shared(void *ptr)
+{
+    struct demux_packet_shared *shared = *(struct demux_packet_shared **)ptr;
+    if (--shared->refcount == 0) {
+        free(shared->allocation);
+        talloc_free(shared);
+    }
+    return 0;
+}
+
+static void ref_shared(struct demux_packet *dp,
+                       struct demux_packet_shared *shared)
+{
+    struct demux_packet_shared **ref = talloc_ptrtype(dp, ref);
+    *ref = shared;
+    shared->refcount++;
+    talloc_set_destructor(ref, unref_shared);
+    dp->shared = shared;
+}
+
+// Return a new packet containing len bytes of dp's data, starting at offset.
+// If possible, the data is not copied, but referenced: both packets can be
+// freed in any order, but they can't be resized anymore. Note that the
+// padding of the new packet is not cleared in this case.
+struct demux_packet *demux_packet_slice(struct demux_packet *dp,
+                                        size_t offset, size_t len)
+{
+    assert(offset <= dp->len && len <= dp->len - offset);
+    if (dp->allocation) {
+        struct demux_packet_shared *shared = talloc_ptrtype(NULL, shared);
+        *shared = (struct demux_packet_shared) {
+            .allocation = dp->allocation,
+        };
+        dp->allocation = NULL;
+        ref_shared(dp, shared);
+    }
+    if (!dp->shared)
+        return new_demux_packet_from(dp->buffer + offset, len);
+    struct demux_packet *new = new_demux_packet_fromdata(dp->buffer + offset,
+                                                         len);
+    ref_shared(new, dp->shared);
+    return new;
+}
+
 void free_demux_packet(struct demux_packet *dp)
 {
     talloc_free(dp);
@@ -221,6 +272,7 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
         memcpy(new->buffer, dp->buffer, new->len);
     }
     new->pts = dp->pts;
+    new->dts = dp->dts;
     new->duration = dp->duration;
     new->stream_pts = dp->stream_pts;
     return new;
@@ -31,6 +31,7 @@
 #include "stheader.h"
 
 struct MPOpts;
+struct stream;
 
 #define MAX_PACKS 4096
 #define MAX_PACK_BYTES 0x8000000  // 128 MiB
@@ -139,6 +140,12 @@ struct matroska_data {
     int num_ordered_chapters;
 };
 
+/* Read the segment UIDs of all segments in a Matroska file, without parsing
+ * the other header elements. Segments without UID get an all-zero UID.
+ * Return the number of segments (0 if it's not a Matroska file). */
+int demux_mkv_read_segment_uids(struct stream *s, void *talloc_ctx,
+                                unsigned char (**uids)[16]);
+
 typedef struct demux_attachment
 {
     char *name;
@@ -147,6 +154,13 @@ typedef struct demux_attachment
     unsigned int data_size;
 } demux_attachment_t;
 
+/* Read the attachments of the given segment of a Matroska file, without
+ * opening a demuxer. The attachments are allocated with talloc_ctx. Return
+ * their number (0 if it's not a Matroska file). */
+int demux_mkv_read_attachments_only(struct stream *s, int segment,
+                                    void *talloc_ctx,
+                                    struct demux_attachment **list);
+
 struct demuxer_params {
     unsigned char (*matroska_wanted_uids)[16];
     int matroska_wanted_segment;
@@ -210,6 +224,8 @@ struct demux_packet *new_demux_packet(size_t len);
 struct demux_packet *new_demux_packet_fromdata(void *data, size_t len);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
 void resize_demux_packet(struct demux_packet *dp, size_t len);
+struct demux_packet *demux_packet_slice(struct demux_packet *dp,
+                                        size_t offset, size_t len);
 void free_demux_packet(struct demux_packet *dp);
 struct demux_packet *demux_copy_packet(struct demux_packet *dp);
 
@@ -40,10 +40,12 @@
 #include "mpvcore/av_opts.h"
 #include "mpvcore/av_common.h"
 #include "mpvcore/bstr.h"
+#include "mpvcore/mp_talloc.h"
 
 #include "stream/stream.h"
 #include "demux.h"
 #include "stheader.h"
+#include "index_cache.h"
 #include "mpvcore/m_option.h"
 
 #define INITIAL_PROBE_SIZE STREAM_BUFFER_SIZE
@@ -89,6 +91,7 @@ typedef struct lavf_priv {
     bool genpts_hack;
     AVPacket *packets[MAX_PKT_QUEUE];
     int num_packets;
+    int cached_index_entries;
 } lavf_priv_t;
 
 struct format_hack {
@@ -518,6 +521,64 @@ static void add_metadata(demuxer_t *demuxer, AVDictionary *metadata)
         demux_info_add(demuxer, t->key, t->value);
 }
 
+static int count_index_entries(AVFormatContext *avfc)
+{
+    int num = 0;
+    for (int n = 0; n < avfc->nb_streams; n++)
+        num += avfc->streams[n]->nb_index_entries;
+    return num;
+}
+
+// Formats with AVFMT_GENERIC_INDEX build their index while packets are read,
+// and seek with it, so restoring it from an earlier run helps seeking.
+static void load_index_cache(demuxer_t *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+
+    if (!(avfc->iformat->flags & AVFMT_GENERIC_INDEX))
+        return;
+    int num = 0;
+    struct demux_index_entry *entries =
+        demux_index_cache_load(demuxer, NULL, &num);
+    for (int n = 0; n < num; n++) {
+        struct demux_index_entry *e = &entries[n];
+        if (e->stream < 0 || e->stream >= (int)avfc->nb_streams)
+            continue;
+        av_add_index_entry(avfc->streams[e->stream], e->pos, e->ts, 0, 0,
+                           e->flags);
+    }
+    talloc_free(entries);
+    priv->cached_index_entries = count_index_entries(avfc);
+}
+
+static void save_index_cache(demuxer_t *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+
+    if (!(avfc->iformat->flags & AVFMT_GENERIC_INDEX) ||
+        count_index_entries(avfc) <= priv->cached_index_entries)
+        return;
+    struct demux_index_entry *entries = NULL;
+    int num = 0;
+    for (int n = 0; n < avfc->nb_streams; n++) {
+        AVStream *st = avfc->streams[n];
+        for (int i = 0; i < st->nb_index_entries; i++) {
+            AVIndexEntry *ie = &st->index_entries[i];
+            struct demux_index_entry e = {
+                .stream = n,
+                .pos = ie->pos,
+                .ts = ie->timestamp,
+                .flags = ie->flags & AVINDEX_KEYFRAME,
+            };
+            MP_TARRAY_APPEND(NULL, entries, num, e);
+        }
+    }
+    demux_index_cache_save(demuxer, entries, num);
+    talloc_free(entries);
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     struct MPOpts *opts = demuxer->opts;
@@ -619,6 +680,8 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     mp_msg(MSGT_HEADER, MSGL_V, "demux_lavf: avformat_find_stream_info() "
            "finished after %"PRId64" bytes.\n", stream_tell(demuxer->stream));
 
+    load_index_cache(demuxer);
+
     for (i = 0; i < avfc->nb_chapters; i++) {
         AVChapter *c = avfc->chapters[i];
         uint64_t start = av_rescale_q(c->start, c->time_base,
@@ -797,6 +860,8 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
         if (pkt->convergence_duration > 0)
             dp->duration = pkt->convergence_duration * av_q2d(st->time_base);
     }
+    if (pkt->dts != AV_NOPTS_VALUE)
+        dp->dts = pkt->dts * av_q2d(st->time_base);
     dp->pos = demux->filepos;
     dp->keyframe = pkt->flags & AV_PKT_FLAG_KEY;
     // Use only one stream for stream_pts, otherwise PTS might be jumpy.
@@ -1013,6 +1078,7 @@ static void demux_close_lavf(demuxer_t *demuxer)
     lavf_priv_t *priv = demuxer->priv;
     if (priv) {
         if (priv->avfc) {
+            save_index_cache(demuxer);
             av_freep(&priv->avfc->key);
             avformat_close_input(&priv->avfc);
         }
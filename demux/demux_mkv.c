@@ -42,12 +42,14 @@
 #endif
 
 #include "talloc.h"
+#include "mpvcore/mp_talloc.h"
 #include "mpvcore/options.h"
 #include "mpvcore/bstr.h"
 #include "stream/stream.h"
 #include "demux.h"
 #include "stheader.h"
 #include "ebml.h"
+#include "index_cache.h"
 #include "matroska.h"
 #include "codec_tags.h"
 
@@ -146,9 +148,6 @@ typedef struct mkv_track {
     mkv_content_encoding_t *encodings;
     int num_encodings;
 
-    /* latest added index entry for this track */
-    int last_index_entry;
-
     /* For VobSubs and SSA/ASS */
     sh_sub_t *sh_sub;
 } mkv_track_t;
@@ -158,6 +157,31 @@ typedef struct mkv_index {
     uint64_t timecode, filepos;
 } mkv_index_t;
 
+// Maximum number of index entries coded relative to a block's first entry.
+#define INDEX_BLOCK_SIZE 64
+
+struct mkv_index_block {
+    uint64_t timecode, filepos;     // values of the first entry
+    int first;                      // position of the first entry
+};
+
+struct mkv_index_delta {
+    uint32_t timecode, filepos;
+};
+
+// Seek index of a single track, sorted by timecode. To keep it compact, each
+// entry stores only the difference to the previous entry in the same block
+// (0 for the first entry). A new block starts every INDEX_BLOCK_SIZE entries,
+// or if a difference doesn't fit.
+struct mkv_track_index {
+    int tnum;
+    struct mkv_index_block *blocks;
+    int num_blocks;
+    struct mkv_index_delta *deltas;
+    int num_entries;
+    mkv_index_t last;               // copy of the last entry
+};
+
 typedef struct mkv_demuxer {
     int64_t segment_start;
 
@@ -172,9 +196,11 @@ typedef struct mkv_demuxer {
     uint64_t cluster_start;
     uint64_t cluster_end;
 
-    mkv_index_t *indexes;
+    struct mkv_track_index *indexes;    // one per track with index entries
     int num_indexes;
     bool index_complete;
+    bool headers_only;          // read_block() skips all block payloads
+    int cached_index_entries;   // entries loaded from the index cache
     uint64_t deferred_cues;
 
     int64_t *parsed_pos;
@@ -199,19 +225,6 @@ typedef struct mkv_demuxer {
 // Maximum number of subtitle packets that are accepted for pre-roll.
 #define NUM_SUB_PREROLL_PACKETS 100
 
-/**
- * \brief ensures there is space for at least one additional element
- * \param array array to grow
- * \param nelem current number of elements in array
- * \param elsize size of one array element
- */
-static void *grow_array(void *array, int nelem, size_t elsize)
-{
-    if (!(nelem & 31))
-        array = realloc(array, (nelem + 32) * elsize);
-    return array;
-}
-
 static bool is_parsed_header(struct mkv_demuxer *mkv_d, int64_t pos)
 {
     int low = 0;
@@ -560,7 +573,6 @@ static void parse_trackentry(struct demuxer *demuxer,
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
     struct mkv_track *track = talloc_zero_size(NULL, sizeof(*track));
-    track->last_index_entry = -1;
 
     track->tnum = entry->track_number;
     if (track->tnum)
@@ -679,17 +691,216 @@ static int demux_mkv_read_tracks(demuxer_t *demuxer)
     return 0;
 }
 
+static struct mkv_track_index *get_track_index(struct mkv_demuxer *mkv_d,
+                                               int tnum)
+{
+    for (int n = 0; n < mkv_d->num_indexes; n++) {
+        if (mkv_d->indexes[n].tnum == tnum)
+            return &mkv_d->indexes[n];
+    }
+    struct mkv_track_index new = { .tnum = tnum };
+    MP_TARRAY_APPEND(mkv_d, mkv_d->indexes, mkv_d->num_indexes, new);
+    return &mkv_d->indexes[mkv_d->num_indexes - 1];
+}
+
+static void free_index_list(struct mkv_track_index *indexes, int num_indexes)
+{
+    for (int n = 0; n < num_indexes; n++) {
+        talloc_free(indexes[n].blocks);
+        talloc_free(indexes[n].deltas);
+    }
+    talloc_free(indexes);
+}
+
+static void free_indexes(struct mkv_demuxer *mkv_d)
+{
+    for (int n = 0; n < mkv_d->num_indexes; n++) {
+        talloc_free(mkv_d->indexes[n].blocks);
+        talloc_free(mkv_d->indexes[n].deltas);
+    }
+    mkv_d->num_indexes = 0;
+}
+
+static int index_block_end(struct mkv_track_index *ti, int b)
+{
+    return b + 1 < ti->num_blocks ? ti->blocks[b + 1].first : ti->num_entries;
+}
+
+// Return entry n.
+static mkv_index_t index_get(struct mkv_track_index *ti, int n)
+{
+    assert(n >= 0 && n < ti->num_entries);
+    int lo = 0, hi = ti->num_blocks - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (ti->blocks[mid].first <= n) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    struct mkv_index_block *block = &ti->blocks[lo];
+    mkv_index_t e = {ti->tnum, block->timecode, block->filepos};
+    for (int i = block->first + 1; i <= n; i++) {
+        e.timecode += ti->deltas[i].timecode;
+        e.filepos += ti->deltas[i].filepos;
+    }
+    return e;
+}
+
+// Return all entries as a flat array.
+static mkv_index_t *index_get_all(void *talloc_ctx, struct mkv_track_index *ti)
+{
+    mkv_index_t *res = talloc_array(talloc_ctx, mkv_index_t, ti->num_entries);
+    for (int b = 0; b < ti->num_blocks; b++) {
+        struct mkv_index_block *block = &ti->blocks[b];
+        mkv_index_t e = {ti->tnum, block->timecode, block->filepos};
+        for (int i = block->first; i < index_block_end(ti, b); i++) {
+            e.timecode += ti->deltas[i].timecode;
+            e.filepos += ti->deltas[i].filepos;
+            res[i] = e;
+        }
+    }
+    return res;
+}
+
+// Return the number of entries with a timecode below target (in ns).
+static int index_lower_bound(struct mkv_track_index *ti, uint64_t tc_scale,
+                             uint64_t target)
+{
+    int lo = 0, hi = ti->num_blocks;
+    // Find the first block starting at or after target.
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ti->blocks[mid].timecode * tc_scale < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0)
+        return 0;
+    // The result is within the block before it.
+    int b = lo - 1;
+    uint64_t timecode = ti->blocks[b].timecode;
+    int i = ti->blocks[b].first;
+    int end = index_block_end(ti, b);
+    for (i++; i < end; i++) {
+        timecode += ti->deltas[i].timecode;
+        if (timecode * tc_scale >= target)
+            break;
+    }
+    return i;
+}
+
+static void index_append(struct mkv_track_index *ti, uint64_t timecode,
+                         uint64_t filepos)
+{
+    struct mkv_index_delta delta = {0, 0};
+    bool new_block = true;
+    if (ti->num_entries) {
+        assert(timecode >= ti->last.timecode);
+        uint64_t d_tc = timecode - ti->last.timecode;
+        uint64_t d_pos = filepos - ti->last.filepos;
+        int first = ti->blocks[ti->num_blocks - 1].first;
+        new_block = ti->num_entries - first >= INDEX_BLOCK_SIZE ||
+                    filepos < ti->last.filepos ||
+                    d_tc > UINT32_MAX || d_pos > UINT32_MAX;
+        if (!new_block) {
+            delta.timecode = d_tc;
+            delta.filepos = d_pos;
+        }
+    }
+    if (new_block) {
+        struct mkv_index_block block = {timecode, filepos, ti->num_entries};
+        MP_TARRAY_APPEND(NULL, ti->blocks, ti->num_blocks, block);
+    }
+    int num_deltas = ti->num_entries;
+    MP_TARRAY_APPEND(NULL, ti->deltas, num_deltas, delta);
+    ti->num_entries++;
+    ti->last = (mkv_index_t){ti->tnum, timecode, filepos};
+}
+
 static void cue_index_add(demuxer_t *demuxer, int track_id, uint64_t filepos,
                           uint64_t timecode)
+{
+    mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+    struct mkv_track_index *ti = get_track_index(mkv_d, track_id);
+
+    if (!ti->num_entries || timecode >= ti->last.timecode) {
+        index_append(ti, timecode, filepos);
+        return;
+    }
+
+    // Out of order (shouldn't happen with sane files): rebuild the index.
+    int num = ti->num_entries;
+    mkv_index_t *entries = index_get_all(NULL, ti);
+    MP_TARRAY_APPEND(NULL, entries, num, (mkv_index_t){0});
+    int pos = num - 1;
+    while (pos > 0 && entries[pos - 1].timecode > timecode) {
+        entries[pos] = entries[pos - 1];
+        pos--;
+    }
+    entries[pos] = (mkv_index_t){track_id, timecode, filepos};
+    ti->num_blocks = ti->num_entries = 0;
+    for (int n = 0; n < num; n++)
+        index_append(ti, entries[n].timecode, entries[n].filepos);
+    talloc_free(entries);
+}
+
+static int count_index_entries(struct mkv_demuxer *mkv_d)
+{
+    int num = 0;
+    for (int n = 0; n < mkv_d->num_indexes; n++)
+        num += mkv_d->indexes[n].num_entries;
+    return num;
+}
+
+// Restore the index built by a previous run on a file without cues.
+static void load_index_cache(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+
+    int num = 0;
+    struct demux_index_entry *entries =
+        demux_index_cache_load(demuxer, NULL, &num);
+    for (int n = 0; n < num; n++) {
+        struct demux_index_entry *e = &entries[n];
+        if (e->pos < mkv_d->segment_start || e->ts < 0)
+            continue;
+        struct mkv_track_index *ti = get_track_index(mkv_d, e->stream);
+        if (ti->num_entries && ((uint64_t)e->ts <= ti->last.timecode ||
+                                (uint64_t)e->pos <= ti->last.filepos))
+            continue;
+        index_append(ti, e->ts, e->pos);
+    }
+    talloc_free(entries);
+    mkv_d->cached_index_entries = count_index_entries(mkv_d);
+}
+
+static void save_index_cache(demuxer_t *demuxer)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
 
-    mkv_d->indexes = grow_array(mkv_d->indexes, mkv_d->num_indexes,
-                                sizeof(mkv_index_t));
-    mkv_d->indexes[mkv_d->num_indexes].tnum = track_id;
-    mkv_d->indexes[mkv_d->num_indexes].timecode = timecode;
-    mkv_d->indexes[mkv_d->num_indexes].filepos = filepos;
-    mkv_d->num_indexes++;
+    if (mkv_d->index_complete ||
+        count_index_entries(mkv_d) <= mkv_d->cached_index_entries)
+        return;
+    struct demux_index_entry *entries = NULL;
+    int num = 0;
+    for (int n = 0; n < mkv_d->num_indexes; n++) {
+        struct mkv_track_index *ti = &mkv_d->indexes[n];
+        for (int i = 0; i < ti->num_entries; i++) {
+            mkv_index_t index = index_get(ti, i);
+            struct demux_index_entry e = {
+                .stream = ti->tnum,
+                .pos = index.filepos,
+                .ts = index.timecode,
+            };
+            MP_TARRAY_APPEND(NULL, entries, num, e);
+        }
+    }
+    demux_index_cache_save(demuxer, entries, num);
+    talloc_free(entries);
 }
 
 static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
@@ -699,16 +910,38 @@ static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
 
     if (mkv_d->index_complete || !track)
         return;
-    if (track->last_index_entry >= 0) {
-        mkv_index_t *index = &mkv_d->indexes[track->last_index_entry];
+    struct mkv_track_index *ti = get_track_index(mkv_d, track->tnum);
+    if (ti->num_entries) {
         // filepos is always the cluster position, which can contain multiple
         // blocks with different timecodes - one is enough.
         // Also, never add block which are already covered by the index.
-        if (index->filepos == filepos || index->timecode >= timecode)
+        if (ti->last.filepos == filepos || ti->last.timecode >= timecode)
             return;
     }
-    cue_index_add(demuxer, track->tnum, filepos, timecode);
-    track->last_index_entry = mkv_d->num_indexes - 1;
+    index_append(ti, timecode, filepos);
+}
+
+static void add_cue_point(void *ctx, uint32_t id, void *element)
+{
+    demuxer_t *demuxer = ctx;
+    mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+    struct ebml_cue_point *cuepoint = element;
+
+    if (cuepoint->n_cue_time != 1 || !cuepoint->n_cue_track_positions) {
+        mp_msg(MSGT_DEMUX, MSGL_WARN, "[mkv] Malformed CuePoint element\n");
+        return;
+    }
+    uint64_t time = cuepoint->cue_time;
+    for (int c = 0; c < cuepoint->n_cue_track_positions; c++) {
+        struct ebml_cue_track_positions *trackpos =
+            &cuepoint->cue_track_positions[c];
+        uint64_t pos = mkv_d->segment_start + trackpos->cue_cluster_position;
+        cue_index_add(demuxer, trackpos->cue_track, pos, time);
+        mp_msg(MSGT_DEMUX, MSGL_DBG2,
+               "[mkv] |+ found cue point for track %" PRIu64
+               ": timecode %" PRIu64 ", filepos: %" PRIu64 "\n",
+               trackpos->cue_track, time, pos);
+    }
 }
 
 static int demux_mkv_read_cues(demuxer_t *demuxer)
@@ -723,37 +956,31 @@ static int demux_mkv_read_cues(demuxer_t *demuxer)
     }
 
     mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] /---- [ parsing cues ] -----------\n");
-    struct ebml_cues cues = {};
-    struct ebml_parse_ctx parse_ctx = {};
-    if (ebml_read_element(s, &parse_ctx, &cues, &ebml_cues_desc) < 0)
-        return -1;
 
+    // Add the CuePoints to a new index, so that the existing one can be kept
+    // if the Cues turn out to be truncated or broken.
+    struct mkv_track_index *old_indexes = mkv_d->indexes;
+    int old_num_indexes = mkv_d->num_indexes;
+    mkv_d->indexes = NULL;
     mkv_d->num_indexes = 0;
 
-    for (int i = 0; i < cues.n_cue_point; i++) {
-        struct ebml_cue_point *cuepoint = &cues.cue_point[i];
-        if (cuepoint->n_cue_time != 1 || !cuepoint->n_cue_track_positions) {
-            mp_msg(MSGT_DEMUX, MSGL_WARN, "[mkv] Malformed CuePoint element\n");
-            continue;
-        }
-        uint64_t time = cuepoint->cue_time;
-        for (int c = 0; c < cuepoint->n_cue_track_positions; c++) {
-            struct ebml_cue_track_positions *trackpos =
-                &cuepoint->cue_track_positions[c];
-            uint64_t pos = mkv_d->segment_start + trackpos->cue_cluster_position;
-            cue_index_add(demuxer, trackpos->cue_track, pos, time);
-            mp_msg(MSGT_DEMUX, MSGL_DBG2,
-                   "[mkv] |+ found cue point for track %" PRIu64
-                   ": timecode %" PRIu64 ", filepos: %" PRIu64 "\n",
-                   trackpos->cue_track, time, pos);
-        }
+    // The Cues element can be huge, so add the CuePoints one by one, instead
+    // of reading all of it into memory first.
+    struct ebml_parse_ctx parse_ctx = {};
+    int res = ebml_read_element_streaming(s, &parse_ctx, &ebml_cues_desc,
+                                          add_cue_point, demuxer);
+    if (res < 0) {
+        free_index_list(mkv_d->indexes, mkv_d->num_indexes);
+        mkv_d->indexes = old_indexes;
+        mkv_d->num_indexes = old_num_indexes;
+        return -1;
     }
+    free_index_list(old_indexes, old_num_indexes);
 
     // Do not attempt to create index on the fly.
     mkv_d->index_complete = true;
 
     mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] \\---- [ parsing cues ] -----------\n");
-    talloc_free(parse_ctx.talloc_ctx);
     return 0;
 }
 
@@ -1682,15 +1909,14 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    save_index_cache(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
-    free(mkv_d->indexes);
+    free_indexes(mkv_d);
 }
 
-static int read_ebml_header(demuxer_t *demuxer)
+static int read_ebml_header(stream_t *s)
 {
-    stream_t *s = demuxer->stream;
-
     if (ebml_read_id(s, NULL) != EBML_ID_EBML)
         return 0;
     struct ebml_ebml ebml_master = {};
@@ -1754,7 +1980,7 @@ static int read_mkv_segment_header(demuxer_t *demuxer)
             return 0;
         }
         // Segments are like concatenated Matroska files
-        if (!read_ebml_header(demuxer))
+        if (!read_ebml_header(s))
             return 0;
     }
 
@@ -1762,6 +1988,136 @@ static int read_mkv_segment_header(demuxer_t *demuxer)
     return 0;
 }
 
+static void read_segment_uid(stream_t *s, unsigned char uid[16])
+{
+    while (!s->eof) {
+        uint32_t id = ebml_read_id(s, NULL);
+        if (s->eof || id == EBML_ID_INVALID || id == MATROSKA_ID_CLUSTER)
+            return;
+        if (id == MATROSKA_ID_INFO) {
+            struct ebml_info info = {};
+            struct ebml_parse_ctx parse_ctx = { .no_error_messages = true };
+            if (ebml_read_element(s, &parse_ctx, &info, &ebml_info_desc) >= 0
+                && info.n_segment_uid && info.segment_uid.len == 16)
+                memcpy(uid, info.segment_uid.start, 16);
+            talloc_free(parse_ctx.talloc_ctx);
+            return;
+        }
+        if (ebml_read_skip(s, NULL) != 0)
+            return;
+    }
+}
+
+int demux_mkv_read_segment_uids(struct stream *s, void *talloc_ctx,
+                                unsigned char (**uids)[16])
+{
+    unsigned char (*res)[16] = NULL;
+    int num = 0;
+
+    stream_seek(s, s->start_pos);
+    while (read_ebml_header(s)) {
+        if (ebml_read_id(s, NULL) != MATROSKA_ID_SEGMENT)
+            break;
+        uint64_t len = ebml_read_length(s, NULL);
+        int64_t end = stream_tell(s) + len;
+        MP_TARRAY_GROW(talloc_ctx, res, num);
+        memset(res[num], 0, 16);
+        read_segment_uid(s, res[num]);
+        num++;
+        // Segments are like concatenated Matroska files
+        if (len == EBML_UINT_INVALID || !stream_seek(s, end))
+            break;
+    }
+
+    *uids = res;
+    return num;
+}
+
+// Parse the Attachments element at the current position, and append the
+// valid attachments to *list.
+static int read_attachment_list(stream_t *s, void *talloc_ctx,
+                                struct demux_attachment **list)
+{
+    struct ebml_attachments attachments = {};
+    struct ebml_parse_ctx parse_ctx = { .no_error_messages = true };
+    int num = 0;
+    if (ebml_read_element(s, &parse_ctx, &attachments,
+                          &ebml_attachments_desc) >= 0)
+    {
+        for (int i = 0; i < attachments.n_attached_file; i++) {
+            struct ebml_attached_file *a = &attachments.attached_file[i];
+            if (!a->n_file_name || !a->n_file_mime_type || !a->n_file_data)
+                continue;
+            MP_TARRAY_GROW(talloc_ctx, *list, num);
+            (*list)[num] = (struct demux_attachment) {
+                .name = bstrdup0(talloc_ctx, a->file_name),
+                .type = bstrdup0(talloc_ctx, a->file_mime_type),
+                .data = talloc_memdup(talloc_ctx, a->file_data.start,
+                                      a->file_data.len),
+                .data_size = a->file_data.len,
+            };
+            num++;
+        }
+    }
+    talloc_free(parse_ctx.talloc_ctx);
+    return num;
+}
+
+int demux_mkv_read_attachments_only(struct stream *s, int segment,
+                                    void *talloc_ctx,
+                                    struct demux_attachment **list)
+{
+    *list = NULL;
+    stream_seek(s, s->start_pos);
+    for (int n = 0; ; n++) {
+        if (!read_ebml_header(s) ||
+            ebml_read_id(s, NULL) != MATROSKA_ID_SEGMENT)
+            return 0;
+        uint64_t len = ebml_read_length(s, NULL);
+        if (n == segment)
+            break;
+        // Segments are like concatenated Matroska files
+        if (len == EBML_UINT_INVALID || !stream_seek(s, stream_tell(s) + len))
+            return 0;
+    }
+
+    // Attachments are usually stored before the first cluster. If they are
+    // not, the SeekHead tells where they are.
+    int64_t segment_start = stream_tell(s);
+    int64_t seek_pos = -1;
+    while (!s->eof) {
+        uint32_t id = ebml_read_id(s, NULL);
+        if (s->eof || id == EBML_ID_INVALID || id == MATROSKA_ID_CLUSTER)
+            break;
+        if (id == MATROSKA_ID_ATTACHMENTS)
+            return read_attachment_list(s, talloc_ctx, list);
+        if (id == MATROSKA_ID_SEEKHEAD && seek_pos < 0) {
+            struct ebml_seek_head seekhead = {};
+            struct ebml_parse_ctx parse_ctx = { .no_error_messages = true };
+            if (ebml_read_element(s, &parse_ctx, &seekhead,
+                                  &ebml_seek_head_desc) < 0)
+            {
+                talloc_free(parse_ctx.talloc_ctx);
+                break;
+            }
+            for (int i = 0; i < seekhead.n_seek; i++) {
+                struct ebml_seek *seek = &seekhead.seek[i];
+                if (seek->n_seek_id && seek->n_seek_position &&
+                    seek->seek_id == MATROSKA_ID_ATTACHMENTS)
+                    seek_pos = segment_start + seek->seek_position;
+            }
+            talloc_free(parse_ctx.talloc_ctx);
+            continue;
+        }
+        if (ebml_read_skip(s, NULL) != 0)
+            break;
+    }
+    if (seek_pos >= 0 && stream_seek(s, seek_pos) &&
+        ebml_read_id(s, NULL) == MATROSKA_ID_ATTACHMENTS)
+        return read_attachment_list(s, talloc_ctx, list);
+    return 0;
+}
+
 static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 {
     stream_t *s = demuxer->stream;
@@ -1769,7 +2125,7 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 
     stream_seek(s, s->start_pos);
 
-    if (!read_ebml_header(demuxer))
+    if (!read_ebml_header(s))
         return -1;
     mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] Found the head...\n");
 
@@ -1812,6 +2168,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
         demuxer->movi_start = s->start_pos;
         demuxer->movi_end = s->end_pos;
         demuxer->seekable = 1;
+        if (!mkv_d->index_complete && !mkv_d->deferred_cues)
+            load_index_cache(demuxer);
     }
 
     return 0;
@@ -1829,17 +2187,14 @@ static bool bstr_read_u8(bstr *buffer, uint8_t *out_u8)
     }
 }
 
-static int demux_mkv_read_block_lacing(bstr *buffer, int *laces,
+static int demux_mkv_read_block_lacing(bstr *buffer, uint8_t flags,
+                                       int *laces,
                                        uint32_t lace_size[MAX_NUM_LACES])
 {
     uint32_t total = 0;
-    uint8_t flags, t;
+    uint8_t t;
     int i;
 
-    /* lacing flags */
-    if (!bstr_read_u8(buffer, &flags))
-        goto error;
-
     int type = (flags >> 1) & 0x03;
     if (type == 0) {           /* no lacing */
         *laces = 1;
@@ -2190,14 +2545,17 @@ struct block_info {
     bool simple, keyframe;
     uint64_t timecode;
     mkv_track_t *track;
+    uint8_t flags;
+    // Block payload following the flags (lacing header and frames). NULL if
+    // the track isn't selected, in which case the payload is skipped.
     bstr data;
-    void *alloc;
+    struct demux_packet *packet; // owns data
 };
 
 static void free_block(struct block_info *block)
 {
-    free(block->alloc);
-    block->alloc = NULL;
+    free_demux_packet(block->packet);
+    block->packet = NULL;
     block->data = (bstr){0};
 }
 
@@ -2210,6 +2568,21 @@ static void index_block(demuxer_t *demuxer, struct block_info *block)
     }
 }
 
+// Return a packet with data, which must be part of the block's data. This
+// avoids copying the data: the block's packet itself is returned if data
+// covers all of it, otherwise a slice referencing it.
+static struct demux_packet *new_block_packet(struct block_info *block,
+                                             bstr data)
+{
+    struct demux_packet *src = block->packet;
+    if (data.start == src->buffer && data.len == src->len) {
+        block->packet = NULL;
+        block->data = (bstr){0};
+        return src;
+    }
+    return demux_packet_slice(src, data.start - src->buffer, data.len);
+}
+
 static int read_block(demuxer_t *demuxer, struct block_info *block)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
@@ -2217,33 +2590,33 @@ static int read_block(demuxer_t *demuxer, struct block_info *block)
     uint64_t num;
     int16_t time;
     uint64_t length;
+    int num_len;
     int res = -1;
 
     free_block(block);
     length = ebml_read_length(s, NULL);
     if (length > 500000000)
         goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
-        goto exit;
-    block->data = (bstr){block->alloc, length};
     demuxer->filepos = stream_tell(s);
-    if (stream_read(s, block->data.start, block->data.len) != block->data.len)
-        goto exit;
+    int64_t end = demuxer->filepos + length;
 
     // Parse header of the Block element
     /* first byte(s): track num */
-    num = ebml_read_vlen_uint(&block->data);
+    num = ebml_read_length(s, &num_len);
     if (num == EBML_UINT_INVALID)
         goto exit;
-    /* time (relative to cluster time) */
-    if (block->data.len < 3)
+    /* time (relative to cluster time), flags */
+    if (length < num_len + 3)
         goto exit;
-    time = block->data.start[0] << 8 | block->data.start[1];
-    block->data.start += 2;
-    block->data.len -= 2;
+    int t0 = stream_read_char(s);
+    int t1 = stream_read_char(s);
+    int flags = stream_read_char(s);
+    if (t0 < 0 || t1 < 0 || flags < 0)
+        goto exit;
+    time = t0 << 8 | t1;
+    block->flags = flags;
     if (block->simple)
-        block->keyframe = block->data.start[0] & 0x80;
+        block->keyframe = flags & 0x80;
     block->timecode = time * mkv_d->tc_scale + mkv_d->cluster_tc;
     for (int i = 0; i < mkv_d->num_tracks; i++) {
         if (mkv_d->tracks[i]->tnum == num) {
@@ -2252,11 +2625,29 @@ static int read_block(demuxer_t *demuxer, struct block_info *block)
         }
     }
     if (!block->track) {
+        stream_skip(s, end - stream_tell(s));
         res = 0;
         goto exit;
     }
 
     res = 1;
+    // The header is enough for indexing; don't read unused frame data.
+    if (mkv_d->headers_only ||
+        !demuxer_stream_is_selected(demuxer, block->track->stream))
+    {
+        if (!stream_skip(s, end - stream_tell(s)))
+            res = -1;
+        goto exit;
+    }
+
+    // Read the payload into a padded packet, so that unlaced frames can be
+    // passed on without copying.
+    size_t payload = end - stream_tell(s);
+    block->packet = new_demux_packet(payload);
+    block->data = (bstr){block->packet->buffer, payload};
+    if (stream_read(s, block->data.start, payload) != payload)
+        res = -1;
+
 exit:
     if (res <= 0)
         free_block(block);
@@ -2277,10 +2668,11 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
     uint32_t lace_size[MAX_NUM_LACES];
     bool use_this_block = tc >= mkv_d->skip_to_timecode;
 
-    if (!demuxer_stream_is_selected(demuxer, stream))
+    if (!data.start || !demuxer_stream_is_selected(demuxer, stream))
         return 0;
 
-    if (demux_mkv_read_block_lacing(&data, &laces, lace_size))
+    if (demux_mkv_read_block_lacing(&data, block_info->flags, &laces,
+                                    lace_size))
         return 0;
 
     current_pts = tc / 1e9;
@@ -2322,10 +2714,13 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
                 bstr buffer = demux_mkv_decode(track, block, 1);
                 mkv_parse_packet(track, &buffer);
                 if (buffer.start) {
-                    demux_packet_t *dp =
-                        new_demux_packet_from(buffer.start, buffer.len);
-                    if (buffer.start != block.start)
+                    demux_packet_t *dp;
+                    if (buffer.start == block.start) {
+                        dp = new_block_packet(block_info, buffer);
+                    } else {
+                        dp = new_demux_packet_from(buffer.start, buffer.len);
                         talloc_free(buffer.start);
+                    }
                     dp->keyframe = keyframe;
                     /* If default_duration is 0, assume no pts value is known
                      * for packets after the first one (rather than all pts
@@ -2391,7 +2786,7 @@ static int read_block_group(demuxer_t *demuxer, int64_t end,
         }
     }
 
-    return block->data.start ? 1 : 0;
+    return block->track ? 1 : 0;
 
 error:
     free_block(block);
@@ -2487,21 +2882,23 @@ static int demux_mkv_fill_buffer(demuxer_t *demuxer)
     }
 }
 
-static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
+static bool get_highest_index_entry(struct demuxer *demuxer,
+                                    mkv_index_t *index)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
     assert(!mkv_d->index_complete); // would require separate code
 
-    mkv_index_t *index = NULL;
-    for (int n = 0; n < mkv_d->num_tracks; n++) {
-        int n_index = mkv_d->tracks[n]->last_index_entry;
-        if (n_index >= 0) {
-            mkv_index_t *index2 = &mkv_d->indexes[n_index];
-            if (!index || index2->filepos > index->filepos)
-                index = index2;
+    // Without cues, entries are added in file order, so the last entry of
+    // each track is the highest one.
+    bool found = false;
+    for (int n = 0; n < mkv_d->num_indexes; n++) {
+        struct mkv_track_index *ti = &mkv_d->indexes[n];
+        if (ti->num_entries && (!found || ti->last.filepos > index->filepos)) {
+            *index = ti->last;
+            found = true;
         }
     }
-    return index;
+    return found;
 }
 
 static int create_index_until(struct demuxer *demuxer, uint64_t timecode)
@@ -2514,17 +2911,20 @@ static int create_index_until(struct demuxer *demuxer, uint64_t timecode)
     if (mkv_d->index_complete)
         return 0;
 
-    mkv_index_t *index = get_highest_index_entry(demuxer);
+    mkv_index_t index;
+    bool have_index = get_highest_index_entry(demuxer, &index);
 
-    if (!index || index->timecode * mkv_d->tc_scale < timecode) {
+    if (!have_index || index.timecode * mkv_d->tc_scale < timecode) {
         int64_t old_filepos = stream_tell(s);
         int64_t old_cluster_start = mkv_d->cluster_start;
         int64_t old_cluster_end = mkv_d->cluster_end;
         uint64_t old_cluster_tc = mkv_d->cluster_tc;
-        if (index)
-            stream_seek(s, index->filepos);
+        if (have_index)
+            stream_seek(s, index.filepos);
         mp_msg(MSGT_DEMUX, MSGL_V,
                "[mkv] creating index until TC %" PRIu64 "\n", timecode);
+        // Only block headers are needed for the index.
+        mkv_d->headers_only = true;
         for (;;) {
             int res;
             struct block_info block;
@@ -2535,27 +2935,29 @@ static int create_index_until(struct demuxer *demuxer, uint64_t timecode)
                 index_block(demuxer, &block);
                 free_block(&block);
             }
-            index = get_highest_index_entry(demuxer);
-            if (index && index->timecode * mkv_d->tc_scale >= timecode)
+            have_index = get_highest_index_entry(demuxer, &index);
+            if (have_index && index.timecode * mkv_d->tc_scale >= timecode)
                 break;
         }
+        mkv_d->headers_only = false;
         stream_seek(s, old_filepos);
         mkv_d->cluster_start = old_cluster_start;
         mkv_d->cluster_end = old_cluster_end;
         mkv_d->cluster_tc = old_cluster_tc;
     }
-    if (!mkv_d->indexes) {
+    if (!mkv_d->num_indexes) {
         mp_msg(MSGT_DEMUX, MSGL_WARN, "[mkv] no target for seek found\n");
         return -1;
     }
     return 0;
 }
 
-static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
-                                        int64_t target_timecode, int flags)
+static bool seek_with_cues(struct demuxer *demuxer, int seek_id,
+                           int64_t target_timecode, int flags,
+                           mkv_index_t *index)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
-    struct mkv_index *index = NULL;
+    bool found = false;
 
     /* Find the entry in the index closest to the target timecode in the
      * give direction. If there are no such entries - we're trying to seek
@@ -2568,11 +2970,20 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
         min_diff = -min_diff;
     min_diff = FFMAX(min_diff, 1);
 
-    for (int i = 0; i < mkv_d->num_indexes; i++)
-        if (seek_id < 0 || mkv_d->indexes[i].tnum == seek_id) {
+    // Only the entries directly before and after the target can be closest.
+    uint64_t split = FFMAX(target_timecode, 0) + !!(flags & SEEK_BACKWARD);
+    for (int t = 0; t < mkv_d->num_indexes; t++) {
+        struct mkv_track_index *ti = &mkv_d->indexes[t];
+        if (seek_id >= 0 && ti->tnum != seek_id)
+            continue;
+        int pos = index_lower_bound(ti, mkv_d->tc_scale, split);
+        for (int i = FFMAX(pos - 1, 0); i < FFMIN(pos + 1, ti->num_entries);
+             i++)
+        {
+            mkv_index_t entry = index_get(ti, i);
             int64_t diff =
                 target_timecode -
-                (int64_t) (mkv_d->indexes[i].timecode * mkv_d->tc_scale);
+                (int64_t) (entry.timecode * mkv_d->tc_scale);
             if (flags & SEEK_BACKWARD)
                 diff = -diff;
             if (diff <= 0) {
@@ -2581,18 +2992,28 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
             } else if (diff >= min_diff)
                 continue;
             min_diff = diff;
-            index = mkv_d->indexes + i;
+            *index = entry;
+            found = true;
         }
+    }
 
-    if (index) {        /* We've found an entry. */
+    if (found) {        /* We've found an entry. */
         uint64_t seek_pos = index->filepos;
         if (mkv_d->subtitle_preroll) {
+            // Start at the closest index position before the target.
             uint64_t prev_target = 0;
-            for (int i = 0; i < mkv_d->num_indexes; i++) {
-                if (seek_id < 0 || mkv_d->indexes[i].tnum == seek_id) {
-                    uint64_t index_pos = mkv_d->indexes[i].filepos;
-                    if (index_pos > prev_target && index_pos < seek_pos)
-                        prev_target = index_pos;
+            for (int t = 0; t < mkv_d->num_indexes; t++) {
+                struct mkv_track_index *ti = &mkv_d->indexes[t];
+                if (seek_id >= 0 && ti->tnum != seek_id)
+                    continue;
+                int pos = index_lower_bound(ti, mkv_d->tc_scale,
+                                            index->timecode * mkv_d->tc_scale);
+                for (int i = FFMIN(pos, ti->num_entries) - 1; i >= 0; i--) {
+                    uint64_t index_pos = index_get(ti, i).filepos;
+                    if (index_pos < seek_pos) {
+                        prev_target = FFMAX(prev_target, index_pos);
+                        break;
+                    }
                 }
             }
             if (prev_target)
@@ -2602,7 +3023,7 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
         mkv_d->cluster_end = 0;
         stream_seek(demuxer->stream, seek_pos);
     }
-    return index;
+    return found;
 }
 
 static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
@@ -2637,7 +3058,8 @@ static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
     rel_seek_secs += flags & SEEK_FORWARD ? -0.005 : 0.005;
 
     if (!(flags & SEEK_FACTOR)) {       /* time in secs */
-        mkv_index_t *index = NULL;
+        mkv_index_t index;
+        bool found = false;
 
         if (!(flags & SEEK_ABSOLUTE))   /* relative seek */
             rel_seek_secs += mkv_d->last_pts;
@@ -2646,12 +3068,15 @@ static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
 
         if (create_index_until(demuxer, target_timecode) >= 0) {
             int seek_id = st_active[STREAM_VIDEO] ? v_tnum : a_tnum;
-            index = seek_with_cues(demuxer, seek_id, target_timecode, flags);
-            if (!index)
-                index = seek_with_cues(demuxer, -1, target_timecode, flags);
+            found = seek_with_cues(demuxer, seek_id, target_timecode, flags,
+                                   &index);
+            if (!found) {
+                found = seek_with_cues(demuxer, -1, target_timecode, flags,
+                                       &index);
+            }
         }
 
-        if (!index)
+        if (!found)
             stream_seek(demuxer->stream, old_pos);
 
         if (st_active[STREAM_VIDEO])
@@ -2659,7 +3084,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
         if (flags & SEEK_FORWARD)
             mkv_d->skip_to_timecode = target_timecode;
         else
-            mkv_d->skip_to_timecode = index ? index->timecode * mkv_d->tc_scale
+            mkv_d->skip_to_timecode = found ? index.timecode * mkv_d->tc_scale
                                             : 0;
         mkv_d->a_skip_to_keyframe = 1;
 
@@ -2670,7 +3095,6 @@ static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
         stream_t *s = demuxer->stream;
         uint64_t target_filepos;
         mkv_index_t *index = NULL;
-        int i;
 
         read_deferred_cues(demuxer);
 
@@ -2681,15 +3105,22 @@ static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
         }
 
         target_filepos = (uint64_t) (demuxer->movi_end * rel_seek_secs);
-        for (i = 0; i < mkv_d->num_indexes; i++)
+        struct mkv_track_index *ti = NULL;
+        for (int i = 0; i < mkv_d->num_indexes; i++) {
             if (mkv_d->indexes[i].tnum == v_tnum)
-                if ((index == NULL)
-                    || ((mkv_d->indexes[i].filepos >= target_filepos)
-                        && ((index->filepos < target_filepos)
-                            || (mkv_d->indexes[i].filepos < index->filepos))))
-                    index = &mkv_d->indexes[i];
+                ti = &mkv_d->indexes[i];
+        }
+        // Rare operation, and the entries aren't sorted by filepos.
+        mkv_index_t *entries = ti ? index_get_all(NULL, ti) : NULL;
+        for (int i = 0; ti && i < ti->num_entries; i++)
+            if ((index == NULL)
+                || ((entries[i].filepos >= target_filepos)
+                    && ((index->filepos < target_filepos)
+                        || (entries[i].filepos < index->filepos))))
+                index = &entries[i];
 
         if (!index) {
+            talloc_free(entries);
             stream_seek(s, old_pos);
             return;
         }
@@ -2701,6 +3132,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, float rel_seek_secs, int flags)
             mkv_d->v_skip_to_keyframe = 1;
         mkv_d->skip_to_timecode = index->timecode * mkv_d->tc_scale;
         mkv_d->a_skip_to_keyframe = 1;
+        talloc_free(entries);
 
         demux_mkv_fill_buffer(demuxer);
     }
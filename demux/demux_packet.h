@@ -26,6 +26,7 @@
 typedef struct demux_packet {
     int len;
     double pts;
+    double dts;           // decoding timestamp, if known (only demux_lavf)
     double duration;
     double stream_pts;
     int64_t pos; // position in index (AVI) or file (MPG)
@@ -33,6 +34,7 @@ typedef struct demux_packet {
     bool keyframe;
     struct demux_packet *next;
     void *allocation;
+    struct demux_packet_shared *shared; // refcounted data (see demux.h)
     struct AVPacket *avpacket;   // original libavformat packet (demux_lavf)
 } demux_packet_t;
 
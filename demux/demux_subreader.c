@@ -1175,7 +1175,7 @@ static sub_data* sub_read_file(stream_t *fd, struct subreader *srp)
     args.previous_sub_end = 0;
     while(1){
         if(sub_num>=n_max){
-            n_max+=16;
+            n_max*=2;
             first=realloc(first,n_max*sizeof(subtitle));
         }
 	memset(sub, '\0', sizeof(subtitle));
@@ -41,6 +41,9 @@
 #define SIZE_MAX ((size_t)-1)
 #endif
 
+// Largest element read into memory as a whole.
+#define MAX_ELEMENT_SIZE 1000000000
+
 /*
  * Read: the element content data ID.
  * Return: the ID.
@@ -708,9 +711,9 @@ int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                    "- partial or corrupt file?\n");
         return -1;
     }
-    if (length > 1000000000) {
+    if (length > MAX_ELEMENT_SIZE) {
         mp_msg(MSGT_DEMUX, msglevel, "[mkv] Refusing to read element over "
-               "100 MB in size\n");
+               "%d MB in size\n", MAX_ELEMENT_SIZE / 1000000);
         return -1;
     }
     ctx->talloc_ctx = talloc_size(NULL, length + 8);
@@ -725,3 +728,85 @@ int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                desc->name);
     return 0;
 }
+
+int ebml_read_element_streaming(struct stream *s, struct ebml_parse_ctx *ctx,
+                                const struct ebml_elem_desc *desc,
+                                ebml_element_cb cb, void *cb_ctx)
+{
+    assert(desc->type == EBML_TYPE_SUBELEMENTS);
+    ctx->has_errors = false;
+    int msglevel = ctx->no_error_messages ? MSGL_DBG2 : MSGL_WARN;
+    uint64_t length = ebml_read_length(s, &ctx->bytes_read);
+    if (s->eof || length == EBML_UINT_INVALID) {
+        mp_msg(MSGT_DEMUX, msglevel, "[mkv] Unexpected end of file "
+                   "- partial or corrupt file?\n");
+        return -1;
+    }
+    int64_t start = stream_tell(s);
+    int64_t end = start + length;
+    int ret = 0;
+    while (stream_tell(s) < end) {
+        uint32_t id = ebml_read_id(s, NULL);
+        if (id == EBML_ID_INVALID || s->eof) {
+            ctx->has_errors = true;
+            ret = -1;
+            break;
+        }
+        const struct ebml_field_desc *fd = NULL;
+        for (int i = 0; i < desc->field_count; i++) {
+            if (desc->fields[i].id == id &&
+                desc->fields[i].desc->type == EBML_TYPE_SUBELEMENTS)
+                fd = &desc->fields[i];
+        }
+        if (!fd) {
+            mp_msg(MSGT_DEMUX, MSGL_DBG2, "[mkv] Skipping subelement %x of "
+                   "%s\n", id, desc->name);
+            if (ebml_read_skip(s, NULL) != 0) {
+                ctx->has_errors = true;
+                ret = -1;
+                break;
+            }
+            continue;
+        }
+        uint64_t child_length = ebml_read_length(s, NULL);
+        if (child_length == EBML_UINT_INVALID) {
+            ctx->has_errors = true;
+            ret = -1;
+            break;
+        }
+        if (child_length > end - stream_tell(s)) {
+            // Try to parse what is possible from inside this partial element
+            ctx->has_errors = true;
+            child_length = FFMAX(end - stream_tell(s), 0);
+        }
+        if (child_length > MAX_ELEMENT_SIZE) {
+            mp_msg(MSGT_DEMUX, msglevel, "[mkv] Refusing to read element over "
+                   "%d MB in size\n", MAX_ELEMENT_SIZE / 1000000);
+            ctx->has_errors = true;
+            ret = -1;
+            break;
+        }
+        // Only a single child is in memory at a time.
+        struct ebml_parse_ctx child_ctx = {
+            .talloc_ctx = talloc_size(NULL, child_length + 8),
+        };
+        int read_len = stream_read(s, child_ctx.talloc_ctx, child_length);
+        void *target = talloc_zero_size(child_ctx.talloc_ctx, fd->desc->size);
+        ebml_parse_element(&child_ctx, target, child_ctx.talloc_ctx, read_len,
+                           fd->desc, 1);
+        ctx->has_errors |= child_ctx.has_errors;
+        cb(cb_ctx, id, target);
+        talloc_free(child_ctx.talloc_ctx);
+        if (read_len < child_length) {
+            mp_msg(MSGT_DEMUX, msglevel, "[mkv] Unexpected end of file "
+                   "- partial or corrupt file?\n");
+            ret = -1;
+            break;
+        }
+    }
+    ctx->bytes_read += stream_tell(s) - start;
+    if (ctx->has_errors)
+        mp_msg(MSGT_DEMUX, msglevel, "[mkv] Error parsing element %s\n",
+               desc->name);
+    return ret;
+}
@@ -106,4 +106,19 @@ uint32_t ebml_read_master (stream_t *s, uint64_t *length);
 int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                       void *target, const struct ebml_elem_desc *desc);
 
+// Called for each child of an element read by ebml_read_element_streaming().
+// element is a struct of the type described by the child's ebml_elem_desc,
+// and is freed after the callback returns.
+typedef void (*ebml_element_cb)(void *cb_ctx, uint32_t id, void *element);
+
+// Like ebml_read_element(), but instead of reading the whole element into
+// memory and filling a struct for it, parse one direct child at a time and
+// pass it to cb. Only children described as EBML_TYPE_SUBELEMENTS in desc
+// are parsed; all other children are skipped. Returns -1 if the element
+// could not be read to its end, even if cb was already called for some
+// children.
+int ebml_read_element_streaming(struct stream *s, struct ebml_parse_ctx *ctx,
+                                const struct ebml_elem_desc *desc,
+                                ebml_element_cb cb, void *cb_ctx);
+
 #endif /* MPLAYER_EBML_H */
@@ -0,0 +1,179 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libavutil/md5.h>
+
+#include "talloc.h"
+#include "osdep/io.h"
+#include "mpvcore/options.h"
+#include "mpvcore/path.h"
+#include "mpvcore/mp_msg.h"
+#include "mpvcore/mp_talloc.h"
+#include "stream/stream.h"
+#include "demux.h"
+#include "index_cache.h"
+
+#define INDEX_CACHE_DIR "index_cache"
+#define INDEX_CACHE_VERSION "mpv-index-cache 1"
+
+// Number of bytes at the start of the file that are hashed.
+#define HASHED_SIZE (64 * 1024)
+
+static char *md5_hex(void *talloc_ctx, const void *data, int len)
+{
+    uint8_t md5[16];
+    av_md5_sum(md5, data, len);
+    char *res = talloc_strdup(talloc_ctx, "");
+    for (int i = 0; i < 16; i++)
+        res = talloc_asprintf_append(res, "%02X", md5[i]);
+    return res;
+}
+
+// Return the header identifying the file's current contents, and set
+// *cache_file to the name of the cache file. Return NULL if the file can't be
+// cached.
+static char *get_file_id(void *talloc_ctx, struct demuxer *demuxer,
+                         char **cache_file)
+{
+    struct stream *s = demuxer->stream;
+    if (!demuxer->opts->index_cache || s->uncached_type != STREAMTYPE_FILE ||
+        !s->path)
+        return NULL;
+
+    void *tmp = talloc_new(NULL);
+    char *res = NULL;
+    char *cwd = mp_getcwd(tmp);
+    if (!cwd)
+        goto exit;
+    char *path = mp_path_join(tmp, bstr0(cwd), bstr0(s->path));
+
+    struct stat st;
+    if (mp_stat(path, &st) != 0)
+        goto exit;
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        goto exit;
+    char *data = talloc_size(tmp, HASHED_SIZE);
+    int len = fread(data, 1, HASHED_SIZE, f);
+    fclose(f);
+
+    char *name = talloc_asprintf(tmp, "%s/%s", INDEX_CACHE_DIR,
+                                 md5_hex(tmp, path, strlen(path)));
+    *cache_file = talloc_steal(talloc_ctx, mp_find_user_config_file(name));
+    if (!*cache_file)
+        goto exit;
+
+    res = talloc_asprintf(talloc_ctx, "%s\n%s\n%s\n%"PRId64" %"PRId64" %s\n",
+                          INDEX_CACHE_VERSION, demuxer->desc->name, path,
+                          (int64_t)st.st_size, (int64_t)st.st_mtime,
+                          md5_hex(tmp, data, len));
+
+exit:
+    talloc_free(tmp);
+    return res;
+}
+
+struct demux_index_entry *demux_index_cache_load(struct demuxer *demuxer,
+                                                 void *talloc_ctx,
+                                                 int *num_entries)
+{
+    void *tmp = talloc_new(NULL);
+    struct demux_index_entry *entries = NULL;
+    *num_entries = 0;
+
+    char *cache_file = NULL;
+    char *id = get_file_id(tmp, demuxer, &cache_file);
+    if (!id)
+        goto exit;
+
+    FILE *f = fopen(cache_file, "rb");
+    if (!f)
+        goto exit;
+
+    // The header must match exactly.
+    int id_len = strlen(id);
+    char *header = talloc_zero_size(tmp, id_len + 1);
+    if (fread(header, 1, id_len, f) != (size_t)id_len || strcmp(header, id) != 0) {
+        mp_msg(MSGT_DEMUX, MSGL_V, "[index-cache] Ignoring outdated index.\n");
+        fclose(f);
+        goto exit;
+    }
+
+    struct demux_index_entry e;
+    while (fscanf(f, "%d %"SCNd64" %"SCNd64" %d\n",
+                  &e.stream, &e.pos, &e.ts, &e.flags) == 4)
+        MP_TARRAY_APPEND(talloc_ctx, entries, *num_entries, e);
+    fclose(f);
+
+    mp_msg(MSGT_DEMUX, MSGL_V, "[index-cache] Loaded %d index entries from "
+           "'%s'.\n", *num_entries, cache_file);
+
+exit:
+    talloc_free(tmp);
+    return entries;
+}
+
+void demux_index_cache_save(struct demuxer *demuxer,
+                            struct demux_index_entry *entries,
+                            int num_entries)
+{
+    void *tmp = talloc_new(NULL);
+
+    char *cache_file = NULL;
+    char *id = get_file_id(tmp, demuxer, &cache_file);
+    if (!id || !num_entries)
+        goto exit;
+
+    char *dir = mp_find_user_config_file(INDEX_CACHE_DIR);
+    if (dir)
+        mkdir(dir, 0777);
+    talloc_free(dir);
+
+    // Write to a temporary file first, so that concurrently running instances
+    // never see partially written files.
+    char *tmp_file = talloc_asprintf(tmp, "%s.tmp%d", cache_file, (int)getpid());
+    FILE *f = fopen(tmp_file, "wb");
+    if (!f)
+        goto exit;
+    bool ok = fputs(id, f) >= 0;
+    for (int n = 0; n < num_entries && ok; n++) {
+        struct demux_index_entry *e = &entries[n];
+        ok = fprintf(f, "%d %"PRId64" %"PRId64" %d\n",
+                     e->stream, e->pos, e->ts, e->flags) > 0;
+    }
+    ok = !fclose(f) && ok;
+    if (ok && rename(tmp_file, cache_file) == 0) {
+        mp_msg(MSGT_DEMUX, MSGL_V, "[index-cache] Saved %d index entries to "
+               "'%s'.\n", num_entries, cache_file);
+    } else {
+        mp_msg(MSGT_DEMUX, MSGL_WARN, "[index-cache] Could not write '%s'.\n",
+               cache_file);
+        unlink(tmp_file);
+    }
+
+exit:
+    talloc_free(tmp);
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPV_DEMUX_INDEX_CACHE_H
+#define MPV_DEMUX_INDEX_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct demuxer;
+
+// Seek index entry as stored by the index cache. The meaning of the fields
+// (except pos) is up to the demuxer.
+struct demux_index_entry {
+    int stream;
+    int64_t pos;        // byte position in the file
+    int64_t ts;
+    int flags;
+};
+
+/**
+ * Load the seek index saved for the demuxer's file (--index-cache).
+ *
+ * The file is identified by its absolute path, size, modification time, and
+ * a hash of its start, so an index saved for a file that was changed since
+ * is never used.
+ *
+ * talloc_ctx:  talloc context of the returned array
+ * num_entries: set to the number of entries returned
+ * return:      the entries, in the order they were saved, or NULL if the
+ *              cache is disabled, or if there is no usable index
+ */
+struct demux_index_entry *demux_index_cache_load(struct demuxer *demuxer,
+                                                 void *talloc_ctx,
+                                                 int *num_entries);
+
+/**
+ * Save the seek index for the demuxer's file, replacing any old one. Does
+ * nothing if the cache is disabled, or if the file is not a local file.
+ */
+void demux_index_cache_save(struct demuxer *demuxer,
+                            struct demux_index_entry *entries,
+                            int num_entries);
+
+#endif
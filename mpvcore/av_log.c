@@ -41,6 +41,10 @@
 #include <libavfilter/avfilter.h>
 #endif
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 static int av_log_level_to_mp_level(int av_level)
 {
     if (av_level > AV_LOG_VERBOSE)
@@ -124,8 +128,44 @@ static void mp_msg_av_log_callback(void *ptr, int level, const char *fmt,
     mp_msg_va(type, mp_level, fmt, vl);
 }
 
+#if HAVE_PTHREADS
+// Opening and closing codecs isn't thread-safe in libavcodec unless a lock
+// manager is registered. Codecs are opened from several threads (demuxers
+// opened in the background, screenshot encoders, vo_image).
+static int lavc_lock_callback(void **mutex, enum AVLockOp op)
+{
+    switch (op) {
+    case AV_LOCK_CREATE:
+        *mutex = malloc(sizeof(pthread_mutex_t));
+        if (!*mutex)
+            return 1;
+        if (pthread_mutex_init(*mutex, NULL)) {
+            free(*mutex);
+            *mutex = NULL;
+            return 1;
+        }
+        return 0;
+    case AV_LOCK_OBTAIN:
+        return !!pthread_mutex_lock(*mutex);
+    case AV_LOCK_RELEASE:
+        return !!pthread_mutex_unlock(*mutex);
+    case AV_LOCK_DESTROY:
+        pthread_mutex_destroy(*mutex);
+        free(*mutex);
+        *mutex = NULL;
+        return 0;
+    }
+    return 1;
+}
+#endif
+
 void init_libav(void)
 {
+#if HAVE_PTHREADS
+    if (av_lockmgr_register(lavc_lock_callback) < 0)
+        mp_msg(MSGT_CPLAYER, MSGL_WARN, "Could not register libav lock "
+               "manager.\n");
+#endif
     av_log_set_callback(mp_msg_av_log_callback);
     avcodec_register_all();
     av_register_all();
@@ -293,9 +293,29 @@ int bstr_decode_utf8(struct bstr s, struct bstr *out_next)
     return codepoint;
 }
 
+// Return the number of leading ASCII bytes. Checks 8 bytes at once, which makes
+// validating mostly-ASCII text (most subtitle files) much faster.
+static size_t ascii_prefix(struct bstr s)
+{
+    size_t n = 0;
+    while (s.len - n >= sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, s.start + n, sizeof(w));
+        if (w & 0x8080808080808080ULL)
+            break;
+        n += sizeof(w);
+    }
+    while (n < s.len && s.start[n] < 128)
+        n++;
+    return n;
+}
+
 int bstr_validate_utf8(struct bstr s)
 {
     while (s.len) {
+        s = bstr_cut(s, ascii_prefix(s));
+        if (!s.len)
+            break;
         if (bstr_decode_utf8(s, &s) < 0) {
             // Try to guess whether the sequence was just cut-off.
             unsigned int codepoint = (unsigned char)s.start[0];
@@ -331,6 +351,9 @@ struct bstr bstr_sanitize_utf8_latin1(void *talloc_ctx, struct bstr s)
     bstr left = s;
     unsigned char *first_ok = s.start;
     while (left.len) {
+        left = bstr_cut(left, ascii_prefix(left));
+        if (!left.len)
+            break;
         int r = bstr_decode_utf8(left, &left);
         if (r < 0) {
             append_bstr(&new, (bstr){first_ok, left.start - first_ok});
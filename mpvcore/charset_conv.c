@@ -199,37 +199,76 @@ bstr mp_charset_guess_and_conv_to_utf8(bstr buf, const char *user_cp, int flags)
     return mp_iconv_to_utf8(buf, mp_charset_guess(buf, user_cp, flags), flags);
 }
 
-// Use iconv to convert buf to UTF-8.
-// Returns buf.start==NULL on error. Returns buf if cp is NULL, or if there is
-// obviously no conversion required (e.g. if cp is "UTF-8").
-// Returns a newly allocated buffer if conversion is done and succeeds. The
-// buffer will be terminated with 0 for convenience (the terminating 0 is not
-// included in the returned length).
-// Free the returned buffer with talloc_free().
-//  buf: input data
+struct mp_iconv {
+    char *cp;
+    int flags;
+#ifdef CONFIG_ICONV
+    iconv_t icdsc;              // (iconv_t)-1 if no iconv conversion needed
+#endif
+};
+
+#ifdef CONFIG_ICONV
+static int close_iconv(void *ptr)
+{
+    struct mp_iconv *ic = ptr;
+    if (ic->icdsc != (iconv_t) (-1))
+        iconv_close(ic->icdsc);
+    return 0;
+}
+#endif
+
+static bool needs_iconv(const char *cp)
+{
+    return cp && cp[0] && !mp_charset_is_utf8(cp) &&
+           strcasecmp(cp, "ASCII") != 0 && strcasecmp(cp, "UTF-8-BROKEN") != 0;
+}
+
+// Create a converter from cp to UTF-8, which can be used to convert multiple
+// buffers with mp_iconv_conv() without reopening iconv every time.
+//  talloc_ctx: talloc parent of the returned object (free with talloc_free())
 //  cp: iconv codepage (or NULL)
 //  flags: combination of MP_ICONV_* flags
-//  returns: buf (no conversion), .start==NULL (error), or allocated buffer
-bstr mp_iconv_to_utf8(bstr buf, const char *cp, int flags)
+//  returns: converter, or NULL if iconv doesn't support the codepage
+struct mp_iconv *mp_iconv_open(void *talloc_ctx, const char *cp, int flags)
 {
+    struct mp_iconv *ic = talloc_ptrtype(talloc_ctx, ic);
+    *ic = (struct mp_iconv) {
+        .cp = talloc_strdup(ic, cp),
+        .flags = flags,
+    };
 #ifdef CONFIG_ICONV
-    if (!cp || !cp[0] || mp_charset_is_utf8(cp))
-        return buf;
-
-    if (strcasecmp(cp, "ASCII") == 0)
-        return buf;
+    ic->icdsc = (iconv_t) (-1);
+    if (needs_iconv(cp)) {
+        if ((ic->icdsc = iconv_open("UTF-8", cp)) == (iconv_t) (-1)) {
+            if (flags & MP_ICONV_VERBOSE)
+                mp_msg(MSGT_SUBREADER, MSGL_ERR,
+                       "Error opening iconv with codepage '%s'\n", cp);
+            talloc_free(ic);
+            return NULL;
+        }
+    }
+    talloc_set_destructor(ic, close_iconv);
+#endif
+    return ic;
+}
 
-    if (strcasecmp(cp, "UTF-8-BROKEN") == 0)
-        return bstr_sanitize_utf8_latin1(NULL, buf);
+// Convert buf to UTF-8. Same semantics as mp_iconv_to_utf8().
+bstr mp_iconv_conv(struct mp_iconv *ic, bstr buf)
+{
+#ifdef CONFIG_ICONV
+    const char *cp = ic->cp;
+    int flags = ic->flags;
 
-    iconv_t icdsc;
-    if ((icdsc = iconv_open("UTF-8", cp)) == (iconv_t) (-1)) {
-        if (flags & MP_ICONV_VERBOSE)
-            mp_msg(MSGT_SUBREADER, MSGL_ERR,
-                   "Error opening iconv with codepage '%s'\n", cp);
-        goto failure;
+    if (!needs_iconv(cp)) {
+        if (cp && strcasecmp(cp, "UTF-8-BROKEN") == 0)
+            return bstr_sanitize_utf8_latin1(NULL, buf);
+        return buf;
     }
 
+    iconv_t icdsc = ic->icdsc;
+    // Start with the initial conversion state.
+    iconv(icdsc, NULL, NULL, NULL, NULL);
+
     size_t size = buf.len;
     size_t osize = size;
     size_t ileft = size;
@@ -269,19 +308,36 @@ bstr mp_iconv_to_utf8(bstr buf, const char *cp, int flags)
                            "Error recoding text with codepage '%s'\n", cp);
                 }
                 talloc_free(outbuf);
-                iconv_close(icdsc);
                 goto failure;
             }
         } else if (clear)
             break;
     }
 
-    iconv_close(icdsc);
-
     outbuf[osize - oleft - 1] = 0;
     return (bstr){outbuf, osize - oleft - 1};
-#endif
-
 failure:
+#endif
     return (bstr){0};
 }
+
+// Use iconv to convert buf to UTF-8.
+// Returns buf.start==NULL on error. Returns buf if cp is NULL, or if there is
+// obviously no conversion required (e.g. if cp is "UTF-8").
+// Returns a newly allocated buffer if conversion is done and succeeds. The
+// buffer will be terminated with 0 for convenience (the terminating 0 is not
+// included in the returned length).
+// Free the returned buffer with talloc_free().
+//  buf: input data
+//  cp: iconv codepage (or NULL)
+//  flags: combination of MP_ICONV_* flags
+//  returns: buf (no conversion), .start==NULL (error), or allocated buffer
+bstr mp_iconv_to_utf8(bstr buf, const char *cp, int flags)
+{
+    struct mp_iconv *ic = mp_iconv_open(NULL, cp, flags);
+    if (!ic)
+        return (bstr){0};
+    bstr res = mp_iconv_conv(ic, buf);
+    talloc_free(ic);
+    return res;
+}
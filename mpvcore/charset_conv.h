@@ -16,4 +16,8 @@ const char *mp_charset_guess(bstr buf, const char *user_cp, int flags);
 bstr mp_charset_guess_and_conv_to_utf8(bstr buf, const char *user_cp, int flags);
 bstr mp_iconv_to_utf8(bstr buf, const char *cp, int flags);
 
+struct mp_iconv;
+struct mp_iconv *mp_iconv_open(void *talloc_ctx, const char *cp, int flags);
+bstr mp_iconv_conv(struct mp_iconv *ic, bstr buf);
+
 #endif
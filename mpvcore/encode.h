@@ -7,6 +7,8 @@
 struct MPOpts;
 struct encode_lavc_context;
 struct encode_output_conf;
+struct sh_stream;
+struct demux_packet;
 
 // interface for mplayer.c
 struct encode_lavc_context *encode_lavc_init(struct encode_output_conf *options);
@@ -18,5 +20,10 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx, char *buf, int bufsiz
 void encode_lavc_expect_stream(struct encode_lavc_context *ctx, enum AVMediaType mt);
 void encode_lavc_set_video_fps(struct encode_lavc_context *ctx, float fps);
 bool encode_lavc_didfail(struct encode_lavc_context *ctx); // check if encoding failed
+bool encode_lavc_copy_mode(struct encode_lavc_context *ctx);
+int encode_lavc_alloc_copy_stream(struct encode_lavc_context *ctx,
+                                  struct sh_stream *sh);
+int encode_lavc_write_copy_packet(struct encode_lavc_context *ctx, int index,
+                                  struct demux_packet *dp, double pts_offset);
 
 #endif
@@ -29,6 +29,41 @@
 #include "video/out/vo.h"
 #include "talloc.h"
 #include "stream/stream.h"
+#include "mpvcore/mp_thread_pool.h"
+#include "mpvcore/av_common.h"
+#include "demux/demux_packet.h"
+#include "demux/stheader.h"
+
+#if HAVE_PTHREADS
+#define LOCK(ctx) pthread_mutex_lock(&(ctx)->lock)
+#define UNLOCK(ctx) pthread_mutex_unlock(&(ctx)->lock)
+#define WAIT(ctx) pthread_cond_wait(&(ctx)->wakeup, &(ctx)->lock)
+#define SIGNAL(ctx) pthread_cond_broadcast(&(ctx)->wakeup)
+#else
+#define LOCK(ctx) do {} while (0)
+#define UNLOCK(ctx) do {} while (0)
+#define WAIT(ctx) abort()
+#define SIGNAL(ctx) do {} while (0)
+#endif
+
+// Number of packets that can be queued for the muxer thread.
+#define MUXER_QUEUE_SIZE 256
+
+struct encode_lavc_worker {
+    struct mp_thread_pool *pool;
+    int max_pending;
+    int pending;            // number of queued jobs that haven't finished
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;  // signaled when a job finishes
+#endif
+};
+
+struct worker_job {
+    struct encode_lavc_worker *worker;
+    void (*fn)(void *fn_ctx);
+    void *fn_ctx;
+};
 
 static int set_to_avdictionary(AVDictionary **dictp, const char *key,
                                const char *val)
@@ -101,6 +136,83 @@ static bool value_has_flag(const char *value, const char *flag)
         return val; \
     }
 
+static int destroy_worker(void *ptr)
+{
+    struct encode_lavc_worker *worker = ptr;
+    talloc_free(worker->pool); // waits for remaining jobs
+#if HAVE_PTHREADS
+    pthread_cond_destroy(&worker->wakeup);
+    pthread_mutex_destroy(&worker->lock);
+#endif
+    return 0;
+}
+
+/**
+ * Create a worker, which runs jobs on its own thread in the order they were
+ * queued. At most max_pending jobs can be queued; encode_lavc_worker_queue()
+ * blocks until older jobs have finished if there are more.
+ *
+ * Returns NULL if jobs have to run synchronously (without pthreads, or with
+ * muxers that take pointers to the raw picture instead of encoded data).
+ * The encode_lavc_worker_* functions accept NULL and then run jobs directly.
+ * Freeing the worker waits until all queued jobs have finished.
+ */
+struct encode_lavc_worker *encode_lavc_worker_create(struct encode_lavc_context *ctx,
+                                                     void *talloc_ctx,
+                                                     int max_pending)
+{
+#if HAVE_PTHREADS
+    if (encode_lavc_oformat_flags(ctx) & AVFMT_RAWPICTURE)
+        return NULL;
+    struct encode_lavc_worker *worker =
+        talloc_zero(talloc_ctx, struct encode_lavc_worker);
+    worker->max_pending = FFMAX(max_pending, 1);
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wakeup, NULL);
+    worker->pool = mp_thread_pool_create(worker, 1);
+    talloc_set_destructor(worker, destroy_worker);
+    return worker;
+#else
+    return NULL;
+#endif
+}
+
+static void run_worker_job(void *ptr)
+{
+    struct worker_job *job = ptr;
+    struct encode_lavc_worker *worker = job->worker;
+    job->fn(job->fn_ctx);
+    talloc_free(job);
+    LOCK(worker);
+    worker->pending--;
+    SIGNAL(worker);
+    UNLOCK(worker);
+}
+
+void encode_lavc_worker_queue(struct encode_lavc_worker *worker,
+                              void (*fn)(void *fn_ctx), void *fn_ctx)
+{
+    if (!worker) {
+        fn(fn_ctx);
+        return;
+    }
+    LOCK(worker);
+    while (worker->pending >= worker->max_pending)
+        WAIT(worker);
+    worker->pending++;
+    UNLOCK(worker);
+    struct worker_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct worker_job) { worker, fn, fn_ctx };
+    mp_thread_pool_queue(worker->pool, run_worker_job, job);
+}
+
+// Block until all jobs queued so far have finished.
+void encode_lavc_worker_wait(struct encode_lavc_worker *worker)
+{
+    if (worker)
+        mp_thread_pool_wait(worker->pool);
+}
+
 int encode_lavc_available(struct encode_lavc_context *ctx)
 {
     CHECK_FAIL(ctx, 0);
@@ -131,6 +243,9 @@ struct encode_lavc_context *encode_lavc_init(struct encode_output_conf *options)
         mp_msg_stdout_in_use = 1;
 
     ctx = talloc_zero(NULL, struct encode_lavc_context);
+#if HAVE_PTHREADS
+    pthread_mutex_init(&ctx->lock, NULL);
+#endif
     encode_lavc_discontinuity(ctx);
     ctx->options = options;
 
@@ -207,7 +322,7 @@ struct encode_lavc_context *encode_lavc_init(struct encode_output_conf *options)
                                                       ctx->avc->filename, NULL,
                                                       AVMEDIA_TYPE_AUDIO));
 
-    if (!ctx->vc && !ctx->ac) {
+    if (!ctx->vc && !ctx->ac && !options->copy) {
         encode_lavc_fail(
             ctx, "encode-lavc: neither audio nor video codec was found\n");
         return NULL;
@@ -293,6 +408,9 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
     av_dict_free(&ctx->foptions);
 
     ctx->header_written = 1;
+
+    ctx->muxer = encode_lavc_worker_create(ctx, ctx, MUXER_QUEUE_SIZE);
+
     return 1;
 }
 
@@ -305,6 +423,10 @@ void encode_lavc_free(struct encode_lavc_context *ctx)
         encode_lavc_fail(ctx,
                          "called encode_lavc_free without encode_lavc_finish\n");
 
+    talloc_free(ctx->muxer);
+#if HAVE_PTHREADS
+    pthread_mutex_destroy(&ctx->lock);
+#endif
     talloc_free(ctx);
 }
 
@@ -319,6 +441,10 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
         return;
 
     if (ctx->avc) {
+        // write the packets that are still queued
+        talloc_free(ctx->muxer);
+        ctx->muxer = NULL;
+
         if (ctx->header_written > 0)
             av_write_trailer(ctx->avc);  // this is allowed to fail
 
@@ -344,6 +470,8 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
                 break;
             }
             avcodec_close(ctx->avc->streams[i]->codec);
+            // set by encode_lavc_alloc_copy_stream()
+            av_freep(&ctx->avc->streams[i]->codec->extradata);
             talloc_free(ctx->avc->streams[i]->codec->stats_in);
             av_free(ctx->avc->streams[i]->codec);
             av_free(ctx->avc->streams[i]->info);
@@ -709,10 +837,24 @@ void encode_lavc_write_stats(struct encode_lavc_context *ctx, AVStream *stream)
     }
 }
 
-int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
+struct mux_job {
+    struct encode_lavc_context *ctx;
+    AVPacket packet;
+};
+
+static void write_frame_job(void *ptr)
 {
-    int r;
+    struct mux_job *job = ptr;
+    if (av_interleaved_write_frame(job->ctx->avc, &job->packet) < 0)
+        encode_lavc_fail(job->ctx, "encode-lavc: error writing packet\n");
+    av_free_packet(&job->packet);
+    talloc_free(job);
+}
 
+// The packet data is copied if the muxer runs on its own thread, so the
+// caller can reuse its buffer as soon as this returns.
+int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
+{
     CHECK_FAIL(ctx, -1);
 
     if (ctx->header_written <= 0)
@@ -732,6 +874,8 @@ int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
         / (double)ctx->avc->streams[packet->stream_index]->time_base.den,
         (int)packet->size);
 
+    // called from the video and audio encoder threads
+    LOCK(ctx);
     switch (ctx->avc->streams[packet->stream_index]->codec->codec_type) {
     case AVMEDIA_TYPE_VIDEO:
         ctx->vbytes += packet->size;
@@ -746,10 +890,155 @@ int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
     default:
         break;
     }
+    UNLOCK(ctx);
 
-    r = av_interleaved_write_frame(ctx->avc, packet);
+    if (!ctx->muxer)
+        return av_interleaved_write_frame(ctx->avc, packet);
 
-    return r;
+    struct mux_job *job = talloc_ptrtype(NULL, job);
+    job->ctx = ctx;
+    job->packet = *packet;
+    if (av_dup_packet(&job->packet) < 0) {
+        talloc_free(job);
+        return -1;
+    }
+    encode_lavc_worker_queue(ctx->muxer, write_frame_job, job);
+    return 0;
+}
+
+static void set_copy_extradata(AVCodecContext *codec, const void *data,
+                               int size)
+{
+    if (size <= 0)
+        return;
+    codec->extradata = av_mallocz(size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (codec->extradata) {
+        memcpy(codec->extradata, data, size);
+        codec->extradata_size = size;
+    }
+}
+
+// Allocate an output stream for --ocopy, which takes the packets of sh
+// without re-encoding them. The codec parameters are taken from the demuxer.
+// Returns the stream index, or -1 on error.
+int encode_lavc_alloc_copy_stream(struct encode_lavc_context *ctx,
+                                  struct sh_stream *sh)
+{
+    CHECK_FAIL(ctx, -1);
+
+    if (ctx->header_written) {
+        encode_lavc_fail(ctx, "encode-lavc: --ocopy can't append to an "
+                         "output file that was already started\n");
+        return -1;
+    }
+
+    enum AVCodecID codec_id = mp_codec_to_av_codec_id(sh->codec);
+    if (codec_id == AV_CODEC_ID_NONE || !(sh->video || sh->audio)) {
+        encode_lavc_fail(ctx, "encode-lavc: can't copy codec '%s'\n",
+                         sh->codec ? sh->codec : "unknown");
+        return -1;
+    }
+
+    AVStream *stream = avformat_new_stream(ctx->avc, NULL);
+    if (!stream) {
+        encode_lavc_fail(ctx, "encode-lavc: could not allocate stream\n");
+        return -1;
+    }
+    AVCodecContext *codec = stream->codec;
+
+    if (sh->lav_headers) {
+        mp_copy_lav_codec_headers(codec, sh->lav_headers);
+        // lets the muxer reconstruct dts from the reordered pts
+        codec->has_b_frames = sh->lav_headers->has_b_frames;
+        codec->frame_size = sh->lav_headers->frame_size;
+    } else if (sh->video && sh->video->bih) {
+        BITMAPINFOHEADER *bih = sh->video->bih;
+        codec->width = bih->biWidth;
+        codec->height = bih->biHeight;
+        codec->bits_per_coded_sample = bih->biBitCount;
+        set_copy_extradata(codec, bih + 1, bih->biSize - (int)sizeof(*bih));
+    } else if (sh->audio && sh->audio->wf) {
+        WAVEFORMATEX *wf = sh->audio->wf;
+        codec->channels = wf->nChannels;
+        codec->sample_rate = wf->nSamplesPerSec;
+        codec->bit_rate = wf->nAvgBytesPerSec * 8;
+        codec->block_align = wf->nBlockAlign;
+        codec->bits_per_coded_sample = wf->wBitsPerSample;
+        if (sh->audio->codecdata_len > 0) {
+            set_copy_extradata(codec, sh->audio->codecdata,
+                               sh->audio->codecdata_len);
+        } else {
+            set_copy_extradata(codec, wf + 1, wf->cbSize);
+        }
+    }
+
+    codec->codec_id = codec_id;
+    // the input tag doesn't necessarily mean anything in the output format
+    codec->codec_tag = 0;
+
+    if (sh->video) {
+        codec->codec_type = AVMEDIA_TYPE_VIDEO;
+        if (!codec->width || !codec->height) {
+            codec->width = sh->video->disp_w;
+            codec->height = sh->video->disp_h;
+        }
+        codec->time_base = (AVRational){1, 90000};
+        // Used for packets without duration.
+        if (sh->video->fps > 0)
+            stream->avg_frame_rate = av_d2q(sh->video->fps, 100000);
+    } else {
+        codec->codec_type = AVMEDIA_TYPE_AUDIO;
+        if (!codec->sample_rate)
+            codec->sample_rate = sh->audio->samplerate;
+        if (!codec->channels)
+            codec->channels = sh->audio->channels.num;
+        codec->time_base = (AVRational){1, FFMAX(codec->sample_rate, 1)};
+    }
+    // only a hint; the muxer can change it in encode_lavc_start()
+    stream->time_base = codec->time_base;
+
+    if (ctx->avc->oformat->flags & AVFMT_GLOBALHEADER)
+        codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+    mp_msg(MSGT_ENCODE, MSGL_INFO, "encode-lavc: copying %s stream (%s)\n",
+           sh->video ? "video" : "audio", sh->codec);
+
+    return stream->index;
+}
+
+// Write a packet to a stream allocated with encode_lavc_alloc_copy_stream().
+// pts_offset (in seconds) is added to the packet timestamps.
+int encode_lavc_write_copy_packet(struct encode_lavc_context *ctx, int index,
+                                  struct demux_packet *dp, double pts_offset)
+{
+    AVPacket packet;
+
+    if (!encode_lavc_start(ctx))
+        return -1;
+
+    AVStream *stream = ctx->avc->streams[index];
+    double timebase = av_q2d(stream->time_base);
+
+    mp_set_av_packet(&packet, dp);
+    packet.stream_index = index;
+    if (dp->pts != MP_NOPTS_VALUE)
+        packet.pts = llrint((dp->pts + pts_offset) / timebase);
+    // Video without dts is treated as not reordered (dts = pts) by the
+    // muxer, so the caller has to set dp->dts for streams with B-frames.
+    if (dp->dts != MP_NOPTS_VALUE) {
+        packet.dts = llrint((dp->dts + pts_offset) / timebase);
+    } else if (stream->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
+        // audio packets are never reordered
+        packet.dts = packet.pts;
+    }
+    if (dp->duration > 0) {
+        packet.duration = llrint(dp->duration / timebase);
+    } else if (stream->avg_frame_rate.num > 0) {
+        double fps = av_q2d(stream->avg_frame_rate);
+        packet.duration = llrint(1 / (fps * timebase));
+    }
+
+    return encode_lavc_write_frame(ctx, &packet);
 }
 
 int encode_lavc_supports_pixfmt(struct encode_lavc_context *ctx,
@@ -1016,10 +1305,17 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
 
     CHECK_FAIL(ctx, -1);
 
+    LOCK(ctx);
     minutes = (now - ctx->t0) / 60.0 * (1 - f) / f;
-    megabytes = ctx->avc->pb ? (avio_size(ctx->avc->pb) / 1048576.0 / f) : 0;
+    // The muxer thread may be writing to the output file, so use the amount
+    // of encoded data in this case.
+    if (ctx->muxer)
+        megabytes = (ctx->vbytes + ctx->abytes) / 1048576.0 / f;
+    else
+        megabytes = ctx->avc->pb ? (avio_size(ctx->avc->pb) / 1048576.0 / f) : 0;
     fps = ctx->frames / (now - ctx->t0);
     x = ctx->audioseconds / (now - ctx->t0);
+    UNLOCK(ctx);
     if (ctx->frames)
         snprintf(buf, bufsize, "{%.1fmin %.1ffps %.1fMB}",
                  minutes, fps, megabytes);
@@ -1053,6 +1349,12 @@ bool encode_lavc_didfail(struct encode_lavc_context *ctx)
     return ctx && ctx->failed;
 }
 
+// check if streams are copied instead of re-encoded (--ocopy)
+bool encode_lavc_copy_mode(struct encode_lavc_context *ctx)
+{
+    return ctx && ctx->options->copy;
+}
+
 void encode_lavc_fail(struct encode_lavc_context *ctx, const char *format, ...)
 {
     va_list va;
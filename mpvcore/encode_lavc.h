@@ -29,9 +29,17 @@
 #include <libavutil/opt.h>
 #include <libavutil/mathematics.h>
 
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "encode.h"
 #include "video/csputils.h"
 
+struct encode_lavc_worker;
+
 struct encode_lavc_context {
     struct encode_output_conf *options;
 
@@ -73,6 +81,13 @@ struct encode_lavc_context {
     // has encoding failed?
     bool failed;
     bool finished;
+
+    // writes packets passed to encode_lavc_write_frame(), NULL if the muxer
+    // runs synchronously
+    struct encode_lavc_worker *muxer;
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;   // protects the statistics (vbytes etc.)
+#endif
 };
 
 // interface for vo/ao drivers
@@ -89,6 +104,15 @@ int encode_lavc_oformat_flags(struct encode_lavc_context *ctx);
 double encode_lavc_getoffset(struct encode_lavc_context *ctx, AVStream *stream);
 void encode_lavc_fail(struct encode_lavc_context *ctx, const char *format, ...); // report failure of encoding
 
+// Runs jobs in order on a separate thread. Used to run each encoder and the
+// muxer in parallel with decoding.
+struct encode_lavc_worker *encode_lavc_worker_create(struct encode_lavc_context *ctx,
+                                                     void *talloc_ctx,
+                                                     int max_pending);
+void encode_lavc_worker_queue(struct encode_lavc_worker *worker,
+                              void (*fn)(void *fn_ctx), void *fn_ctx);
+void encode_lavc_worker_wait(struct encode_lavc_worker *worker);
+
 bool encode_lavc_set_csp(struct encode_lavc_context *ctx,
                          AVStream *stream, enum mp_csp csp);
 bool encode_lavc_set_csp_levels(struct encode_lavc_context *ctx,
@@ -59,10 +59,28 @@ enum exit_reason {
   EXIT_SOMENOTPLAYED
 };
 
+// A file referenced by the timeline. Its demuxer is opened when a part using
+// it is entered (or shortly before), and is closed again if too many sources
+// are open and it hasn't been used recently.
+struct timeline_source {
+    char *filename;
+    struct MPOpts *opts;
+    char *demuxer_name;             // forced demuxer, or NULL for probing
+    struct demuxer_params *params;  // or NULL
+    bool enable_cache;
+    bool keep_open;                 // the main file, never closed
+    bool failed;                    // opening failed, don't try again
+    struct demuxer *demuxer;        // NULL if currently closed
+    int64_t last_used;
+    // Set while the demuxer is being opened on mpctx->timeline_prefetch
+    bool prefetching;
+    struct demuxer *prefetched;
+};
+
 struct timeline_part {
     double start;
     double source_start;
-    struct demuxer *source;
+    struct timeline_source *source;
 };
 
 struct chapter {
@@ -155,11 +173,18 @@ typedef struct MPContext {
     struct timeline_part *timeline;
     int num_timeline_parts;
     int timeline_part;
+    struct timeline_source **timeline_sources;
+    int num_timeline_sources;
+    int64_t timeline_use_count;
+    struct mp_thread_pool *timeline_prefetch;
     // NOTE: even if num_chapters==0, chapters being not NULL signifies presence
     //       of chapter metadata
     struct chapter *chapters;
     int num_chapters;
     double video_offset;
+    // Segment UIDs of the files in the directory last searched for ordered
+    // chapter sources (see tl_matroska.c)
+    struct segment_uid_cache *segment_uid_cache;
 
     struct stream *stream;
     struct demuxer *demuxer;
@@ -243,6 +268,7 @@ typedef struct MPContext {
 
     double last_heartbeat;
     double last_metadata_update;
+    double last_input_check;    // only used by the encoding playloop
 
     double mouse_timer;
     unsigned int mouse_event_ts;
@@ -314,6 +340,7 @@ void unpause_player(struct MPContext *mpctx);
 void add_step_frame(struct MPContext *mpctx, int dir);
 void queue_seek(struct MPContext *mpctx, enum seek_type type, double amount,
                 int exact);
+void execute_queued_seek(struct MPContext *mpctx);
 bool mp_seek_chapter(struct MPContext *mpctx, int chapter);
 double get_time_length(struct MPContext *mpctx);
 double get_start_time(struct MPContext *mpctx);
@@ -339,6 +366,13 @@ void mp_force_video_refresh(struct MPContext *mpctx);
 
 void mp_print_version(int always);
 
+struct timeline_source *timeline_add_source(struct MPContext *mpctx,
+                                            const char *filename,
+                                            struct demuxer *demuxer);
+struct demuxer *timeline_open_source(struct MPContext *mpctx,
+                                     struct timeline_source *src);
+void timeline_close_unused_sources(struct MPContext *mpctx);
+
 // timeline/tl_matroska.c
 void build_ordered_chapter_timeline(struct MPContext *mpctx);
 // timeline/tl_edl.c
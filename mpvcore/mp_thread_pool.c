@@ -0,0 +1,171 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "config.h"
+
+#include "talloc.h"
+#include "mpvcore/mp_common.h"
+#include "mp_thread_pool.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+struct work {
+    void (*fn)(void *fn_ctx);
+    void *fn_ctx;
+};
+
+struct mp_thread_pool {
+    int num_threads;
+#if HAVE_PTHREADS
+    pthread_t *threads;
+
+    // All the following members are shared between the threads.
+    // You must lock the mutex to access them.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // signaled on new work and on terminate
+    pthread_cond_t done;        // signaled when the pool becomes idle
+    bool terminate;
+    int busy;                   // number of jobs currently running
+
+    // FIFO, work[0] is the oldest entry
+    struct work *work;
+    int num_work;
+#endif
+};
+
+#if HAVE_PTHREADS
+
+static void *worker_thread(void *arg)
+{
+    struct mp_thread_pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        if (pool->num_work > 0) {
+            struct work work = pool->work[0];
+            MP_TARRAY_REMOVE_AT(pool->work, pool->num_work, 0);
+            pool->busy++;
+            pthread_mutex_unlock(&pool->lock);
+
+            work.fn(work.fn_ctx);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->busy--;
+            if (!pool->busy && !pool->num_work)
+                pthread_cond_broadcast(&pool->done);
+            continue;
+        }
+        if (pool->terminate)
+            break;
+        pthread_cond_wait(&pool->wakeup, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static int pool_destructor(void *ptr)
+{
+    struct mp_thread_pool *pool = ptr;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->terminate = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int n = 0; n < pool->num_threads; n++)
+        pthread_join(pool->threads[n], NULL);
+
+    assert(!pool->num_work && !pool->busy);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_mutex_destroy(&pool->lock);
+    return 0;
+}
+
+struct mp_thread_pool *mp_thread_pool_create(void *talloc_ctx, int threads)
+{
+    struct mp_thread_pool *pool = talloc_zero(talloc_ctx, struct mp_thread_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    talloc_set_destructor(pool, pool_destructor);
+
+    threads = MPMAX(threads, 1);
+    pool->threads = talloc_array(pool, pthread_t, threads);
+    for (int n = 0; n < threads; n++) {
+        if (pthread_create(&pool->threads[n], NULL, worker_thread, pool))
+            break;
+        pool->num_threads++;
+    }
+    // Without any thread, jobs are run synchronously (see below).
+    return pool;
+}
+
+void mp_thread_pool_queue(struct mp_thread_pool *pool,
+                          void (*fn)(void *fn_ctx), void *fn_ctx)
+{
+    if (!pool->num_threads) {
+        fn(fn_ctx);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    MP_TARRAY_APPEND(pool, pool->work, pool->num_work,
+                     (struct work){fn, fn_ctx});
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void mp_thread_pool_wait(struct mp_thread_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy || pool->num_work)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#else /* HAVE_PTHREADS */
+
+struct mp_thread_pool *mp_thread_pool_create(void *talloc_ctx, int threads)
+{
+    return talloc_zero(talloc_ctx, struct mp_thread_pool);
+}
+
+void mp_thread_pool_queue(struct mp_thread_pool *pool,
+                          void (*fn)(void *fn_ctx), void *fn_ctx)
+{
+    fn(fn_ctx);
+}
+
+void mp_thread_pool_wait(struct mp_thread_pool *pool)
+{
+}
+
+#endif /* HAVE_PTHREADS */
+
+int mp_thread_pool_get_threads(struct mp_thread_pool *pool)
+{
+    return MPMAX(pool->num_threads, 1);
+}
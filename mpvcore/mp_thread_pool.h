@@ -0,0 +1,61 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPV_MP_THREAD_POOL_H
+#define MPV_MP_THREAD_POOL_H
+
+/**
+ * A fixed size pool of worker threads, which run queued jobs in FIFO order.
+ * If mpv is compiled without pthreads, jobs are run synchronously by
+ * mp_thread_pool_queue() instead.
+ *
+ * All functions can be called from any thread, but the pool must not be
+ * destroyed while other threads still queue jobs to it.
+ */
+
+struct mp_thread_pool;
+
+/**
+ * Create a pool and start its worker threads.
+ *
+ * talloc_ctx: talloc context of the newly created object. Freeing the pool
+ *             waits until all queued jobs have finished, then joins the
+ *             worker threads.
+ * threads:    number of worker threads (values < 1 are treated as 1)
+ * return:     the newly created pool
+ */
+struct mp_thread_pool *mp_thread_pool_create(void *talloc_ctx, int threads);
+
+/**
+ * Queue a job. fn(fn_ctx) will be called on one of the worker threads.
+ * This never blocks on other jobs.
+ */
+void mp_thread_pool_queue(struct mp_thread_pool *pool,
+                          void (*fn)(void *fn_ctx), void *fn_ctx);
+
+/**
+ * Block until all jobs queued so far (including jobs they queued themselves)
+ * have finished.
+ */
+void mp_thread_pool_wait(struct mp_thread_pool *pool);
+
+/**
+ * Return the number of worker threads.
+ */
+int mp_thread_pool_get_threads(struct mp_thread_pool *pool);
+
+#endif
@@ -43,6 +43,10 @@
 #include <windows.h>
 #endif
 #define WAKEUP_PERIOD 0.5
+// Encoding: decode audio up to this many seconds ahead of the video.
+#define ENCODE_AUDIO_AHEAD 1.0
+// Encoding: check for input commands at this interval (in seconds).
+#define ENCODE_INPUT_PERIOD 0.1
 #include <string.h>
 #include <unistd.h>
 
@@ -141,6 +145,7 @@
 #include "audio/decode/dec_audio.h"
 #include "video/decode/dec_video.h"
 #include "video/mp_image.h"
+#include "video/kernel_scale.h"
 #include "video/filter/vf.h"
 #include "video/decode/vd.h"
 
@@ -196,6 +201,7 @@ static const char av_desync_help_text[] = _(
 
 #include "mpvcore/mp_common.h"
 #include "mpvcore/command.h"
+#include "mpvcore/mp_thread_pool.h"
 
 static void reset_subtitles(struct MPContext *mpctx);
 static void reinit_subs(struct MPContext *mpctx);
@@ -484,12 +490,29 @@ void uninit_player(struct MPContext *mpctx, unsigned int mask)
             mpctx->current_track[t] = NULL;
         assert(!mpctx->sh_video && !mpctx->sh_audio && !mpctx->sh_sub);
         mpctx->master_demuxer = NULL;
+        // Waits for sources that are still being opened
+        talloc_free(mpctx->timeline_prefetch);
+        mpctx->timeline_prefetch = NULL;
+        for (int i = 0; i < mpctx->num_timeline_sources; i++) {
+            struct timeline_source *src = mpctx->timeline_sources[i];
+            if (src->prefetched) {
+                struct stream *stream = src->prefetched->stream;
+                free_demuxer(src->prefetched);
+                free_stream(stream);
+            }
+            talloc_free(src);
+        }
+        talloc_free(mpctx->timeline_sources);
+        mpctx->timeline_sources = NULL;
+        mpctx->num_timeline_sources = 0;
         for (int i = 0; i < mpctx->num_sources; i++) {
             uninit_subs(mpctx->sources[i]);
             struct demuxer *demuxer = mpctx->sources[i];
-            if (demuxer->stream != mpctx->stream)
-                free_stream(demuxer->stream);
+            struct stream *stream = demuxer->stream;
+            // The demuxer may still access the stream when closing
             free_demuxer(demuxer);
+            if (stream != mpctx->stream)
+                free_stream(stream);
         }
         talloc_free(mpctx->sources);
         mpctx->sources = NULL;
@@ -557,6 +580,7 @@ static MP_NORETURN void exit_player(struct MPContext *mpctx,
                                     enum exit_reason how)
 {
     int rc;
+    screenshot_flush(mpctx);
     uninit_player(mpctx, INITIALIZED_ALL);
 
 #ifdef CONFIG_ENCODING
@@ -583,6 +607,10 @@ static MP_NORETURN void exit_player(struct MPContext *mpctx,
     mpctx->ass_library = NULL;
 #endif
 
+    // No filters or VOs are left that could use the shared worker threads.
+    mp_image_uninit_copy_pool();
+    mp_kscale_uninit_pool();
+
     if (how != EXIT_NONE) {
         const char *reason;
         switch (how) {
@@ -2871,10 +2899,177 @@ static void seek_reset(struct MPContext *mpctx, bool reset_ao, bool reset_ac)
 #endif
 }
 
+// Start opening the next part's source this many seconds before the part ends.
+#define TIMELINE_PREFETCH_SECS 5.0
+
+static struct demuxer *open_timeline_demuxer(struct timeline_source *src)
+{
+    struct MPOpts *opts = src->opts;
+    struct stream *s = stream_open(src->filename, opts);
+    if (!s)
+        return NULL;
+    if (src->enable_cache && opts->stream_cache_size > 0) {
+        stream_enable_cache_percent(&s,
+                                    opts->stream_cache_size,
+                                    opts->stream_cache_def_size,
+                                    opts->stream_cache_min_percent,
+                                    opts->stream_cache_seek_min_percent);
+    }
+    struct demuxer *d = demux_open(s, src->demuxer_name, src->params, opts);
+    if (!d)
+        free_stream(s);
+    return d;
+}
+
+// Runs on the timeline_prefetch thread, concurrently with the decoders on
+// the playback thread. Probing the file with libavformat opens codecs, which
+// is safe only because init_libav() registers a libav lock manager.
+static void prefetch_timeline_source(void *ctx)
+{
+    struct timeline_source *src = ctx;
+    src->prefetched = open_timeline_demuxer(src);
+}
+
+// Register a timeline source. If demuxer is not NULL, it's the already opened
+// demuxer of the source, otherwise the file is opened on first use.
+struct timeline_source *timeline_add_source(struct MPContext *mpctx,
+                                            const char *filename,
+                                            struct demuxer *demuxer)
+{
+    struct timeline_source *src = talloc_ptrtype(NULL, src);
+    *src = (struct timeline_source) {
+        .filename = talloc_strdup(src, filename),
+        .opts = mpctx->opts,
+        .keep_open = demuxer && demuxer == mpctx->master_demuxer,
+        .demuxer = demuxer,
+        .last_used = mpctx->timeline_use_count++,
+    };
+    MP_TARRAY_APPEND(NULL, mpctx->timeline_sources,
+                     mpctx->num_timeline_sources, src);
+    if (demuxer) {
+        for (int n = 0; n < mpctx->num_sources; n++) {
+            if (mpctx->sources[n] == demuxer)
+                return src;
+        }
+        MP_TARRAY_APPEND(NULL, mpctx->sources, mpctx->num_sources, demuxer);
+    }
+    return src;
+}
+
+static void close_timeline_source(struct MPContext *mpctx,
+                                  struct timeline_source *src)
+{
+    struct demuxer *demuxer = src->demuxer;
+    struct stream *stream = demuxer->stream;
+    assert(demuxer != mpctx->demuxer && stream != mpctx->stream);
+    mp_msg(MSGT_CPLAYER, MSGL_V, "Closing timeline source %s\n",
+           src->filename);
+    for (int n = 0; n < mpctx->num_sources; n++) {
+        if (mpctx->sources[n] == demuxer) {
+            MP_TARRAY_REMOVE_AT(mpctx->sources, mpctx->num_sources, n);
+            break;
+        }
+    }
+    uninit_subs(demuxer);
+    free_demuxer(demuxer);
+    free_stream(stream);
+    src->demuxer = NULL;
+}
+
+// Close the least recently used sources until at most --timeline-max-open
+// sources are open. The current source and keep are never closed.
+static void close_unused_sources(struct MPContext *mpctx,
+                                 struct timeline_source *keep)
+{
+    int max_open = mpctx->opts->timeline_max_open;
+    while (max_open > 0) {
+        struct timeline_source *oldest = NULL;
+        int num_open = 0;
+        for (int n = 0; n < mpctx->num_timeline_sources; n++) {
+            struct timeline_source *src = mpctx->timeline_sources[n];
+            if (!src->demuxer)
+                continue;
+            num_open++;
+            if (src == keep || src->keep_open || src->demuxer == mpctx->demuxer)
+                continue;
+            if (!oldest || src->last_used < oldest->last_used)
+                oldest = src;
+        }
+        if (num_open <= max_open || !oldest)
+            break;
+        close_timeline_source(mpctx, oldest);
+    }
+}
+
+void timeline_close_unused_sources(struct MPContext *mpctx)
+{
+    close_unused_sources(mpctx, NULL);
+}
+
+// Return the demuxer of the source, opening it if needed. Returns NULL if the
+// source can't be opened.
+struct demuxer *timeline_open_source(struct MPContext *mpctx,
+                                     struct timeline_source *src)
+{
+    src->last_used = mpctx->timeline_use_count++;
+    if (src->demuxer || src->failed)
+        return src->demuxer;
+
+    struct demuxer *demuxer;
+    if (src->prefetching) {
+        mp_thread_pool_wait(mpctx->timeline_prefetch);
+        src->prefetching = false;
+        demuxer = src->prefetched;
+        src->prefetched = NULL;
+    } else {
+        mp_msg(MSGT_CPLAYER, MSGL_V, "Opening timeline source %s\n",
+               src->filename);
+        demuxer = open_timeline_demuxer(src);
+    }
+    if (!demuxer) {
+        mp_msg(MSGT_CPLAYER, MSGL_ERR, "Could not open source '%s'!\n",
+               src->filename);
+        src->failed = true;
+        return NULL;
+    }
+    src->demuxer = demuxer;
+    MP_TARRAY_APPEND(NULL, mpctx->sources, mpctx->num_sources, demuxer);
+    close_unused_sources(mpctx, src);
+    return demuxer;
+}
+
+// Open the source of the next part in the background shortly before the
+// current part ends, so that switching to it doesn't stall playback.
+static void timeline_prefetch_next(struct MPContext *mpctx)
+{
+    int next = mpctx->timeline_part + 1;
+    if (next >= mpctx->num_timeline_parts)
+        return;
+    struct timeline_source *src = mpctx->timeline[next].source;
+    if (src->demuxer || src->failed || src->prefetching)
+        return;
+    if (mpctx->timeline[next].start - get_current_time(mpctx) >
+            TIMELINE_PREFETCH_SECS)
+        return;
+    if (!mpctx->timeline_prefetch)
+        mpctx->timeline_prefetch = mp_thread_pool_create(NULL, 1);
+    mp_msg(MSGT_CPLAYER, MSGL_V, "Prefetching timeline source %s\n",
+           src->filename);
+    src->prefetching = true;
+    mp_thread_pool_queue(mpctx->timeline_prefetch, prefetch_timeline_source,
+                         src);
+}
+
 static bool timeline_set_part(struct MPContext *mpctx, int i, bool force)
 {
     struct timeline_part *p = mpctx->timeline + mpctx->timeline_part;
     struct timeline_part *n = mpctx->timeline + i;
+    struct demuxer *demuxer = timeline_open_source(mpctx, n->source);
+    if (!demuxer) {
+        mpctx->stop_play = PT_NEXT_ENTRY;
+        mpctx->error_playing = true;
+        return false;
+    }
     mpctx->timeline_part = i;
     mpctx->video_offset = n->start - n->source_start;
     if (n->source == p->source && !force)
@@ -2885,7 +3080,7 @@ static bool timeline_set_part(struct MPContext *mpctx, int i, bool force)
     uninit_player(mpctx, INITIALIZED_VCODEC | (mpctx->opts->fixed_vo ? 0 : INITIALIZED_VO) | (mpctx->opts->gapless_audio ? 0 : INITIALIZED_AO) | INITIALIZED_VOL | INITIALIZED_ACODEC | INITIALIZED_SUB);
     mpctx->stop_play = orig_stop_play;
 
-    mpctx->demuxer = n->source;
+    mpctx->demuxer = demuxer;
     mpctx->stream = mpctx->demuxer->stream;
 
     // While another timeline was active, the selection of active tracks might
@@ -3101,7 +3296,7 @@ void queue_seek(struct MPContext *mpctx, enum seek_type type, double amount,
     abort();
 }
 
-static void execute_queued_seek(struct MPContext *mpctx)
+void execute_queued_seek(struct MPContext *mpctx)
 {
     if (mpctx->seek.type) {
         seek(mpctx, mpctx->seek, false);
@@ -3522,6 +3717,50 @@ static double get_wakeup_period(struct MPContext *mpctx)
     return sleeptime;
 }
 
+static void video_init_failed(struct MPContext *mpctx)
+{
+    mp_tmsg(MSGT_CPLAYER, MSGL_FATAL,
+            "\nFATAL: Could not initialize video filters (-vf) "
+            "or video output (-vo).\n");
+    uninit_player(mpctx, INITIALIZED_VCODEC | INITIALIZED_VO);
+    cleanup_demux_stream(mpctx, STREAM_VIDEO);
+    mpctx->current_track[STREAM_VIDEO] = NULL;
+    if (!mpctx->current_track[STREAM_AUDIO])
+        mpctx->stop_play = PT_NEXT_ENTRY;
+    mpctx->error_playing = true;
+}
+
+// Called at the end of each playloop iteration (both for playback and
+// encoding). Handles --playing-msg, --frames and frame stepping.
+static void handle_frame_counting(struct MPContext *mpctx, bool new_frame_shown)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    if (mpctx->stop_play || mpctx->restart_playback)
+        return;
+
+    if (opts->playing_msg && !mpctx->playing_msg_shown && new_frame_shown) {
+        mpctx->playing_msg_shown = true;
+        char *msg = mp_property_expand_string(mpctx, opts->playing_msg);
+        mp_msg(MSGT_CPLAYER, MSGL_INFO, "%s\n", msg);
+        talloc_free(msg);
+    }
+
+    if (mpctx->max_frames >= 0) {
+        if (new_frame_shown)
+            mpctx->max_frames--;
+        if (mpctx->max_frames <= 0)
+            mpctx->stop_play = PT_NEXT_ENTRY;
+    }
+
+    if (mpctx->step_frames > 0 && !mpctx->paused) {
+        if (new_frame_shown)
+            mpctx->step_frames--;
+        if (mpctx->step_frames == 0)
+            pause_player(mpctx);
+    }
+}
+
 static void run_playloop(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -3550,6 +3789,7 @@ static void run_playloop(struct MPContext *mpctx)
             endpts = end;
             end_is_chapter = true;
         }
+        timeline_prefetch_next(mpctx);
     }
 
     if (opts->chapterrange[1] > 0) {
@@ -3575,18 +3815,12 @@ static void run_playloop(struct MPContext *mpctx)
             double frame_time = update_video(mpctx, endpts);
             mp_dbg(MSGT_AVSYNC, MSGL_DBG2, "*** ftime=%5.3f ***\n", frame_time);
             if (mpctx->sh_video->vf_initialized < 0) {
-                mp_tmsg(MSGT_CPLAYER, MSGL_FATAL,
-                        "\nFATAL: Could not initialize video filters (-vf) "
-                        "or video output (-vo).\n");
-                uninit_player(mpctx, INITIALIZED_VCODEC | INITIALIZED_VO);
-                cleanup_demux_stream(mpctx, STREAM_VIDEO);
-                mpctx->current_track[STREAM_VIDEO] = NULL;
-                if (!mpctx->current_track[STREAM_AUDIO])
-                    mpctx->stop_play = PT_NEXT_ENTRY;
-                mpctx->error_playing = true;
+                video_init_failed(mpctx);
                 break;
             }
             video_left = frame_time >= 0;
+            if (vo->frame_loaded)
+                osd_render_ahead(mpctx->osd, mpctx->sh_video->pts);
             if (video_left && !mpctx->restart_playback) {
                 mpctx->time_frame += frame_time / opts->playback_speed;
                 adjust_sync(mpctx, frame_time);
@@ -3782,35 +4016,11 @@ static void run_playloop(struct MPContext *mpctx)
         sleeptime = 0;
     }
 
-    if (!mpctx->stop_play && !mpctx->restart_playback) {
-
-        // If no more video is available, one frame means one playloop iteration.
-        // Otherwise, one frame means one video frame.
-        if (!video_left)
-            new_frame_shown = true;
-
-        if (opts->playing_msg && !mpctx->playing_msg_shown && new_frame_shown) {
-            mpctx->playing_msg_shown = true;
-            char *msg = mp_property_expand_string(mpctx, opts->playing_msg);
-            mp_msg(MSGT_CPLAYER, MSGL_INFO, "%s\n", msg);
-            talloc_free(msg);
-        }
-
-        if (mpctx->max_frames >= 0) {
-            if (new_frame_shown)
-                mpctx->max_frames--;
-            if (mpctx->max_frames <= 0)
-                mpctx->stop_play = PT_NEXT_ENTRY;
-        }
-
-        if (mpctx->step_frames > 0 && !mpctx->paused) {
-            if (new_frame_shown)
-                mpctx->step_frames--;
-            if (mpctx->step_frames == 0)
-                pause_player(mpctx);
-        }
-
-    }
+    // If no more video is available, one frame means one playloop iteration.
+    // Otherwise, one frame means one video frame.
+    if (!video_left)
+        new_frame_shown = true;
+    handle_frame_counting(mpctx, new_frame_shown);
 
     if (!mpctx->stop_play) {
         double audio_sleep = 9;
@@ -3846,6 +4056,8 @@ static void run_playloop(struct MPContext *mpctx)
         }
         if (sleeptime > 0)
             mp_input_get_cmd(mpctx->input, sleeptime * 1000, true);
+        if (mpctx->paused)
+            screenshot_poll(mpctx);
     }
 
     handle_metadata_update(mpctx);
@@ -3863,6 +4075,162 @@ static void run_playloop(struct MPContext *mpctx)
     execute_queued_seek(mpctx);
 }
 
+#ifdef CONFIG_ENCODING
+// Decode and encode audio until the written audio pts reaches limit.
+// Returns false at the end of the audio stream.
+static bool encode_audio(struct MPContext *mpctx, double endpts, double limit)
+{
+    double last_pts = written_audio_pts(mpctx);
+    for (;;) {
+        int status = fill_audio_out_buffers(mpctx, endpts);
+        if (status < -1)
+            return false;
+        if (status < 0)
+            return true;
+        double pts = written_audio_pts(mpctx);
+        // (stop if the AO didn't take anything)
+        if (pts == MP_NOPTS_VALUE || pts >= limit || pts <= last_pts)
+            return true;
+        last_pts = pts;
+    }
+}
+
+// Pass the loaded video frame to the encoder.
+static void encode_video_frame(struct MPContext *mpctx, double endpts)
+{
+    struct vo *vo = mpctx->video_out;
+    struct sh_video *sh_video = mpctx->sh_video;
+
+    vo_new_frame_imminent(vo);
+    mpctx->video_pts = sh_video->pts;
+    mpctx->last_vo_pts = mpctx->video_pts;
+    mpctx->playback_pts = mpctx->video_pts;
+    update_subtitles(mpctx, sh_video->pts);
+    update_osd_msg(mpctx);
+    draw_osd(mpctx);
+    vo_flip_page(vo, mp_time_us() | 1, -1);
+
+    if (mpctx->restart_playback) {
+        // Audio starts at the first video frame after a seek.
+        if (mpctx->sync_audio_to_video && mpctx->sh_audio) {
+            mpctx->syncing_audio = true;
+            fill_audio_out_buffers(mpctx, endpts);
+        }
+        mpctx->restart_playback = false;
+    }
+    print_status(mpctx);
+    screenshot_flip(mpctx);
+}
+
+// Playloop used for encoding (--o). Unlike run_playloop(), this doesn't
+// emulate realtime playback: it never sleeps, there is no A/V sync
+// adjustment, and input is checked every ENCODE_INPUT_PERIOD only. Audio is
+// decoded in large batches, which are kept a bit ahead of the video, so
+// that the muxer gets both streams interleaved.
+static void run_encode_loop(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    bool audio_left = false, video_left = false;
+    double endpts = get_play_end_pts(mpctx);
+    bool end_is_chapter = false;
+    bool new_frame_shown = false;
+
+    if (encode_lavc_didfail(mpctx->encode_lavc_ctx)) {
+        mpctx->stop_play = PT_QUIT;
+        return;
+    }
+
+    double now = mp_time_sec();
+    if (mpctx->paused || now - mpctx->last_input_check >= ENCODE_INPUT_PERIOD) {
+        mpctx->last_input_check = now;
+        if (mpctx->paused) {
+            mp_input_get_cmd(mpctx->input, get_wakeup_period(mpctx) * 1000, true);
+            screenshot_poll(mpctx);
+        }
+        handle_seek_coalesce(mpctx);
+        execute_queued_seek(mpctx);
+        if (mpctx->stop_play || mpctx->paused)
+            return;
+    }
+
+    if (!mpctx->timeline && mpctx->demuxer)
+        add_demuxer_tracks(mpctx, mpctx->demuxer);
+
+    if (mpctx->timeline) {
+        double end = mpctx->timeline[mpctx->timeline_part + 1].start;
+        if (endpts == MP_NOPTS_VALUE || end < endpts) {
+            endpts = end;
+            end_is_chapter = true;
+        }
+        timeline_prefetch_next(mpctx);
+    }
+
+    if (opts->chapterrange[1] > 0) {
+        int cur_chapter = get_current_chapter(mpctx);
+        if (cur_chapter != -1 && cur_chapter + 1 > opts->chapterrange[1])
+            mpctx->stop_play = PT_NEXT_ENTRY;
+    }
+
+    if (mpctx->sh_video) {
+        struct vo *vo = mpctx->video_out;
+        update_fps(mpctx);
+        video_left = vo->hasframe || vo->frame_loaded;
+        if (!vo->frame_loaded) {
+            double frame_time = update_video(mpctx, endpts);
+            if (mpctx->sh_video->vf_initialized < 0) {
+                video_init_failed(mpctx);
+                return;
+            }
+            video_left = frame_time >= 0;
+        }
+        if (endpts != MP_NOPTS_VALUE)
+            video_left &= mpctx->sh_video->pts < endpts;
+    }
+    video_left &= mpctx->sync_audio_to_video; // force no-video semantics
+
+    // Before the first frame after a seek, audio is handled by
+    // encode_video_frame().
+    if (mpctx->sh_audio && !(mpctx->restart_playback && video_left)) {
+        double pos = video_left ? mpctx->sh_video->pts
+                                : written_audio_pts(mpctx);
+        audio_left = true;
+        if (!video_left || written_audio_pts(mpctx) < pos)
+            audio_left = encode_audio(mpctx, endpts, pos + ENCODE_AUDIO_AHEAD);
+        if (!video_left) {
+            mpctx->playback_pts = written_audio_pts(mpctx);
+            print_status(mpctx);
+            if (!mpctx->sh_video)
+                update_subtitles(mpctx, mpctx->playback_pts);
+        }
+    }
+
+    if (video_left && mpctx->video_out->frame_loaded) {
+        encode_video_frame(mpctx, endpts);
+        new_frame_shown = true;
+    }
+    if (!video_left) {
+        mpctx->restart_playback = false;
+        new_frame_shown = true;
+    }
+
+    if ((mpctx->sh_audio || mpctx->sh_video) && !audio_left && !video_left) {
+        if (end_is_chapter) {
+            seek(mpctx, (struct seek_params){
+                        .type = MPSEEK_ABSOLUTE,
+                        .amount = mpctx->timeline[mpctx->timeline_part+1].start
+                        }, true);
+        } else
+            mpctx->stop_play = AT_END_OF_FILE;
+    }
+
+    handle_frame_counting(mpctx, new_frame_shown);
+
+    handle_metadata_update(mpctx);
+
+    execute_queued_seek(mpctx);
+}
+#endif
+
 static bool attachment_is_font(struct demux_attachment *att)
 {
     if (!att->name || !att->type || !att->data || !att->data_size)
@@ -4110,11 +4478,11 @@ static void print_timeline(struct MPContext *mpctx)
         int part_count = mpctx->num_timeline_parts;
         mp_msg(MSGT_CPLAYER, MSGL_V, "Timeline contains %d parts from %d "
                "sources. Total length %.3f seconds.\n", part_count,
-               mpctx->num_sources, mpctx->timeline[part_count].start);
+               mpctx->num_timeline_sources, mpctx->timeline[part_count].start);
         mp_msg(MSGT_CPLAYER, MSGL_V, "Source files:\n");
-        for (int i = 0; i < mpctx->num_sources; i++)
+        for (int i = 0; i < mpctx->num_timeline_sources; i++)
             mp_msg(MSGT_CPLAYER, MSGL_V, "%d: %s\n", i,
-                   mpctx->sources[i]->filename);
+                   mpctx->timeline_sources[i]->filename);
         mp_msg(MSGT_CPLAYER, MSGL_V, "Timeline parts: (number, start, "
                "source_start, source):\n");
         for (int i = 0; i < part_count; i++) {
@@ -4127,19 +4495,52 @@ static void print_timeline(struct MPContext *mpctx)
     }
 }
 
+#ifdef CONFIG_ASS
+static void add_fonts(struct MPContext *mpctx, struct demux_attachment *list,
+                      int num)
+{
+    for (int i = 0; i < num; i++) {
+        struct demux_attachment *att = list + i;
+        if (attachment_is_font(att))
+            ass_add_font(mpctx->ass_library, att->name, att->data,
+                         att->data_size);
+    }
+}
+
+// Timeline sources are opened only when they're played, but fonts can't be
+// added once the renderer exists. Read only the attachments of the sources
+// that aren't open yet (such as the OP/ED files of ordered chapters).
+static void add_fonts_from_closed_sources(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_timeline_sources; n++) {
+        struct timeline_source *src = mpctx->timeline_sources[n];
+        if (src->demuxer || src->failed)
+            continue;
+        if (src->demuxer_name && strcmp(src->demuxer_name, "mkv") != 0)
+            continue;
+        struct stream *s = stream_open(src->filename, mpctx->opts);
+        if (!s)
+            continue;
+        int segment = src->params ? src->params->matroska_wanted_segment : 0;
+        struct demux_attachment *list;
+        void *tmp = talloc_new(NULL);
+        int num = demux_mkv_read_attachments_only(s, segment, tmp, &list);
+        free_stream(s);
+        add_fonts(mpctx, list, num);
+        talloc_free(tmp);
+    }
+}
+#endif
+
 static void add_subtitle_fonts_from_sources(struct MPContext *mpctx)
 {
 #ifdef CONFIG_ASS
-    if (mpctx->opts->ass_enabled) {
+    if (mpctx->opts->ass_enabled && mpctx->opts->use_embedded_fonts) {
         for (int j = 0; j < mpctx->num_sources; j++) {
             struct demuxer *d = mpctx->sources[j];
-            for (int i = 0; i < d->num_attachments; i++) {
-                struct demux_attachment *att = d->attachments + i;
-                if (mpctx->opts->use_embedded_fonts && attachment_is_font(att))
-                    ass_add_font(mpctx->ass_library, att->name, att->data,
-                                 att->data_size);
-            }
+            add_fonts(mpctx, d->attachments, d->num_attachments);
         }
+        add_fonts_from_closed_sources(mpctx);
     }
 
     // libass seems to misbehave if fonts are changed while a renderer
@@ -4251,6 +4652,318 @@ static void transfer_playlist(struct MPContext *mpctx, struct playlist *pl)
     }
 }
 
+#ifdef CONFIG_ENCODING
+// Number of video packets buffered at the start of --ocopy output, to find
+// the reorder delay of streams without dts, and the lowest dts.
+#define REMUX_LOOKAHEAD 32
+// Maximum number of frames a frame can be decoded before it's shown (the
+// same limit as libavcodec's MAX_REORDER_DELAY).
+#define REMUX_MAX_DELAY 16
+
+struct remux_track {
+    struct sh_stream *stream;
+    int index;          // output stream index
+    bool done;
+};
+
+// Generates increasing dts from the pts of a reordered video stream, the same
+// way libavformat does when it muxes packets without dts: the dts of a packet
+// is the (delay+1)-th largest pts seen so far, so that a frame is decoded
+// delay frames before it is shown.
+struct remux_dts {
+    int delay;
+    double largest[REMUX_MAX_DELAY + 1]; // sorted, smallest first
+};
+
+static double remux_dts_next(struct remux_dts *g, double pts)
+{
+    if (pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+    g->largest[0] = pts;
+    for (int i = 0; i < g->delay && g->largest[i] > g->largest[i + 1]; i++)
+        FFSWAP(double, g->largest[i], g->largest[i + 1]);
+    return g->largest[0];
+}
+
+// Determine the reorder delay from the first packets of the stream (in decode
+// order): the maximum number of earlier packets that are shown after a given
+// packet. For streams without B-frames, this is 0, and dts = pts.
+static void remux_dts_init(struct remux_dts *g, struct demux_packet **pkts,
+                           int num)
+{
+    *g = (struct remux_dts){0};
+    double frame_duration = 0;
+    for (int k = 0; k < num; k++) {
+        double pts = pkts[k]->pts;
+        if (pts == MP_NOPTS_VALUE)
+            continue;
+        int later_shown = 0;
+        for (int j = 0; j < k; j++) {
+            double other = pkts[j]->pts;
+            if (other == MP_NOPTS_VALUE)
+                continue;
+            if (other > pts)
+                later_shown++;
+            double diff = fabs(other - pts);
+            if (diff > 0 && (!frame_duration || diff < frame_duration))
+                frame_duration = diff;
+        }
+        g->delay = MPMAX(g->delay, MPMIN(later_shown, REMUX_MAX_DELAY));
+    }
+    if (!frame_duration)
+        frame_duration = num && pkts[0]->duration > 0 ? pkts[0]->duration : 1;
+    // The first frames are decoded at the times of imaginary frames before
+    // the first pts.
+    double first = num ? pkts[0]->pts : MP_NOPTS_VALUE;
+    if (first == MP_NOPTS_VALUE)
+        first = 0;
+    for (int i = 0; i <= g->delay; i++)
+        g->largest[i] = first - (g->delay + 1 - i) * frame_duration;
+}
+
+struct remux_packet {
+    struct remux_track *track;
+    struct demux_packet *dp;
+};
+
+struct remux_output {
+    struct encode_lavc_context *ectx;
+    struct remux_track *video;
+    bool copyts;
+    double origin;      // input pts of the first written packet
+    bool started;       // offset is known, packets are written directly
+    double offset;      // added to the input timestamps
+    bool gen_dts;       // video dts are generated with dts_gen
+    struct remux_dts dts_gen;
+    // Packets read before the offset is known.
+    struct remux_packet *queue;
+    int num_queue;
+    int num_queue_video;
+    int64_t written;
+    bool failed;
+};
+
+static void remux_write(struct remux_output *out, struct remux_track *t,
+                        struct demux_packet *dp)
+{
+    if (out->failed)
+        return;
+    if (t == out->video && out->gen_dts)
+        dp->dts = remux_dts_next(&out->dts_gen, dp->pts);
+    if (encode_lavc_write_copy_packet(out->ectx, t->index, dp,
+                                      out->offset) < 0)
+    {
+        out->failed = true;
+        return;
+    }
+    out->written++;
+}
+
+// Determine the output timestamp offset from the queued packets, and write
+// them. The output starts at 0 (or the input timestamps with --ocopyts), but
+// is shifted if that would make the first dts negative.
+static void remux_start(struct remux_output *out)
+{
+    if (out->started)
+        return;
+    out->started = true;
+
+    double first_dts = MP_NOPTS_VALUE;
+    if (out->num_queue_video) {
+        struct demux_packet **pkts =
+            talloc_array(NULL, struct demux_packet *, out->num_queue_video);
+        int num = 0;
+        for (int n = 0; n < out->num_queue; n++) {
+            if (out->queue[n].track == out->video)
+                pkts[num++] = out->queue[n].dp;
+        }
+        first_dts = pkts[0]->dts;
+        if (first_dts == MP_NOPTS_VALUE) {
+            // Demuxers other than demux_lavf don't provide dts.
+            out->gen_dts = true;
+            remux_dts_init(&out->dts_gen, pkts, num);
+            struct remux_dts tmp = out->dts_gen;
+            first_dts = remux_dts_next(&tmp, pkts[0]->pts);
+        }
+        talloc_free(pkts);
+    }
+
+    out->offset = out->copyts || out->origin == MP_NOPTS_VALUE ? 0
+                                                               : -out->origin;
+    if (first_dts != MP_NOPTS_VALUE && first_dts + out->offset < 0)
+        out->offset = -first_dts;
+
+    for (int n = 0; n < out->num_queue; n++) {
+        remux_write(out, out->queue[n].track, out->queue[n].dp);
+        talloc_free(out->queue[n].dp);
+    }
+    talloc_free(out->queue);
+    out->queue = NULL;
+    out->num_queue = out->num_queue_video = 0;
+}
+
+// Takes ownership of dp.
+static void remux_add(struct remux_output *out, struct remux_track *t,
+                      struct demux_packet *dp)
+{
+    if (!out->started) {
+        MP_TARRAY_APPEND(NULL, out->queue, out->num_queue,
+                         (struct remux_packet){t, dp});
+        if (t == out->video)
+            out->num_queue_video++;
+        if (!out->video || out->video->done ||
+            out->num_queue_video >= REMUX_LOOKAHEAD)
+            remux_start(out);
+        return;
+    }
+    remux_write(out, t, dp);
+    talloc_free(dp);
+}
+
+// --ocopy: write the packets of the selected video and audio tracks to the
+// output file, without decoding them. Cuts are aligned to video keyframes.
+static void remux_file(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct encode_lavc_context *ectx = mpctx->encode_lavc_ctx;
+    struct remux_track tracks[2];
+    int num_tracks = 0;
+    struct remux_track *video = NULL;
+
+    if (mpctx->timeline) {
+        mp_tmsg(MSGT_CPLAYER, MSGL_ERR,
+                "--ocopy doesn't support timelines.\n");
+        return;
+    }
+
+    static const enum stream_type types[] = {STREAM_VIDEO, STREAM_AUDIO};
+    for (int n = 0; n < MP_ARRAY_SIZE(types); n++) {
+        struct track *track = mpctx->current_track[types[n]];
+        if (!track || !track->stream || track->stream->attached_picture)
+            continue;
+        int index = encode_lavc_alloc_copy_stream(ectx, track->stream);
+        if (index < 0)
+            return;
+        tracks[num_tracks] = (struct remux_track){track->stream, index};
+        if (types[n] == STREAM_VIDEO)
+            video = &tracks[num_tracks];
+        num_tracks++;
+    }
+    if (!num_tracks) {
+        mp_tmsg(MSGT_CPLAYER, MSGL_ERR, "No video or audio streams to copy.\n");
+        return;
+    }
+
+    double start = rel_time_to_abs(mpctx, opts->play_start, MP_NOPTS_VALUE);
+    double end = get_play_end_pts(mpctx);
+
+    // Seek to the keyframe before the start. External audio tracks come from
+    // a different demuxer, which has to be seeked separately.
+    if (start != MP_NOPTS_VALUE) {
+        for (int n = 0; n < num_tracks; n++) {
+            struct demuxer *d = tracks[n].stream->demuxer;
+            if (n == 0 || d != tracks[0].stream->demuxer)
+                demux_seek(d, start, SEEK_ABSOLUTE | SEEK_BACKWARD);
+        }
+    }
+
+    struct remux_output out = {
+        .ectx = ectx,
+        .video = video,
+        .copyts = opts->encode_output.copyts,
+        .origin = MP_NOPTS_VALUE,
+    };
+    double cut = MP_NOPTS_VALUE;    // input pts at which the video was cut
+
+    while (!out.failed && !demux_was_interrupted(mpctx)) {
+        // Read from the stream with the lowest timestamp to keep the output
+        // interleaved.
+        struct remux_track *t = NULL;
+        double t_pts = MP_NOPTS_VALUE;
+        for (int n = 0; n < num_tracks; n++) {
+            struct remux_track *cur = &tracks[n];
+            if (cur->done)
+                continue;
+            if (demux_stream_eof(cur->stream)) {
+                cur->done = true;
+                continue;
+            }
+            double pts = demux_get_next_pts(cur->stream);
+            if (!t || (t_pts != MP_NOPTS_VALUE &&
+                       (pts == MP_NOPTS_VALUE || pts < t_pts)))
+            {
+                t = cur;
+                t_pts = pts;
+            }
+        }
+        if (!t)
+            break;
+
+        struct demux_packet *dp = demux_read_packet(t->stream);
+        if (!dp) {
+            t->done = true;
+            continue;
+        }
+        double pts = dp->pts;
+        bool write = true;
+
+        if (t == video) {
+            // Start with a keyframe, and drop frames that are shown before
+            // it (these reference frames from before the cut).
+            if (out.origin == MP_NOPTS_VALUE) {
+                write = dp->keyframe;
+                if (write)
+                    out.origin = pts == MP_NOPTS_VALUE ? 0 : pts;
+            } else if (pts != MP_NOPTS_VALUE && pts < out.origin) {
+                write = false;
+            }
+            // End before the first keyframe after the end time.
+            if (write && dp->keyframe && end != MP_NOPTS_VALUE && pts >= end) {
+                cut = pts;
+                t->done = true;
+                write = false;
+            }
+        } else {
+            if (out.origin == MP_NOPTS_VALUE && !video) {
+                if (start == MP_NOPTS_VALUE || pts == MP_NOPTS_VALUE ||
+                    pts >= start)
+                    out.origin = pts == MP_NOPTS_VALUE ? 0 : pts;
+            }
+            // The audio end is known only once the video has been cut.
+            double limit = end;
+            if (video)
+                limit = video->done ? (cut != MP_NOPTS_VALUE ? cut : end)
+                                    : MP_NOPTS_VALUE;
+            if (out.origin == MP_NOPTS_VALUE ||
+                (pts != MP_NOPTS_VALUE && pts < out.origin))
+            {
+                write = false;
+            } else if (limit != MP_NOPTS_VALUE && pts != MP_NOPTS_VALUE &&
+                       pts >= limit)
+            {
+                t->done = true;
+                write = false;
+            }
+        }
+
+        if (write) {
+            remux_add(&out, t, dp);
+        } else {
+            talloc_free(dp);
+        }
+    }
+    remux_start(&out);
+
+    if (!out.written) {
+        mp_tmsg(MSGT_CPLAYER, MSGL_ERR, "No packets were copied.\n");
+    } else {
+        mp_msg(MSGT_CPLAYER, MSGL_INFO, "Copied %"PRId64" packets.\n",
+               out.written);
+        mpctx->error_playing = out.failed;
+    }
+}
+#endif
+
 // Start playing the current playlist entry.
 // Handle initialization and deinitialization.
 static void play_current_file(struct MPContext *mpctx)
@@ -4415,11 +5128,16 @@ goto_reopen_demuxer: ;
         // On the contrary, the EDL and CUE demuxers are empty wrappers, as
         // well as Matroska ordered chapter playlist-like files.
         for (int n = 0; n < mpctx->num_timeline_parts; n++) {
-            if (mpctx->timeline[n].source == mpctx->demuxer)
+            if (mpctx->timeline[n].source->demuxer == mpctx->demuxer)
                 goto main_is_ok;
         }
-        mpctx->demuxer = mpctx->timeline[0].source;
+        struct demuxer *first = timeline_open_source(mpctx,
+                                                     mpctx->timeline[0].source);
+        if (!first)
+            goto terminate_playback;
+        mpctx->demuxer = first;
     main_is_ok: ;
+        timeline_close_unused_sources(mpctx);
     }
     add_dvd_tracks(mpctx);
     add_demuxer_tracks(mpctx, mpctx->demuxer);
@@ -4451,6 +5169,13 @@ goto_reopen_demuxer: ;
     preselect_demux_streams(mpctx);
 
 #ifdef CONFIG_ENCODING
+    if (encode_lavc_copy_mode(mpctx->encode_lavc_ctx)) {
+        remux_file(mpctx);
+        if (!mpctx->stop_play)
+            mpctx->stop_play = PT_NEXT_ENTRY;
+        goto terminate_playback;
+    }
+
     if (mpctx->encode_lavc_ctx && mpctx->current_track[STREAM_VIDEO])
         encode_lavc_expect_stream(mpctx->encode_lavc_ctx, AVMEDIA_TYPE_VIDEO);
     if (mpctx->encode_lavc_ctx && mpctx->current_track[STREAM_AUDIO])
@@ -4503,6 +5228,13 @@ goto_reopen_demuxer: ;
         goto terminate_playback;
     }
 
+    if (opts->thumbnail_sheet && *opts->thumbnail_sheet) {
+        screenshot_write_sheet(mpctx);
+        if (!mpctx->stop_play)
+            mpctx->stop_play = PT_NEXT_ENTRY;
+        goto terminate_playback;
+    }
+
     mpctx->time_frame = 0;
     mpctx->drop_message_shown = 0;
     mpctx->restart_playback = true;
@@ -4544,8 +5276,16 @@ goto_reopen_demuxer: ;
         pause_player(mpctx);
 
     mpctx->error_playing = false;
-    while (!mpctx->stop_play)
+    mpctx->last_input_check = mp_time_sec();
+    while (!mpctx->stop_play) {
+#ifdef CONFIG_ENCODING
+        if (mpctx->encode_lavc_ctx) {
+            run_encode_loop(mpctx);
+            continue;
+        }
+#endif
         run_playloop(mpctx);
+    }
 
     mp_msg(MSGT_GLOBAL, MSGL_V, "EOF code: %d  \n", mpctx->stop_play);
 
@@ -4724,6 +5464,22 @@ static bool handle_help_options(struct MPContext *mpctx)
     return opt_exit;
 }
 
+// Whether --vo=image:outfd=1 is used, which writes the images to stdout.
+static bool vo_writes_to_stdout(struct MPOpts *opts)
+{
+    struct m_obj_settings *list = opts->vo.video_driver_list;
+    for (int n = 0; list && list[n].name; n++) {
+        if (strcmp(list[n].name, "image") != 0)
+            continue;
+        for (int i = 0; list[n].attribs && list[n].attribs[i]; i += 2) {
+            if (strcmp(list[n].attribs[i], "outfd") == 0 &&
+                atoi(list[n].attribs[i + 1]) == 1)
+                return true;
+        }
+    }
+    return false;
+}
+
 #ifdef PTW32_STATIC_LIB
 static void detach_ptw32(void)
 {
@@ -4823,6 +5579,11 @@ static int mpv_main(int argc, char *argv[])
     if (handle_help_options(mpctx))
         exit_player(mpctx, EXIT_NONE);
 
+    // Like encoding to "-o -" (see encode_lavc_init()), terminal output must
+    // not go to stdout, as it would end up in the image stream.
+    if (vo_writes_to_stdout(opts))
+        mp_msg_stdout_in_use = 1;
+
     mp_msg(MSGT_CPLAYER, MSGL_V, "Configuration: " CONFIGURATION "\n");
     mp_tmsg(MSGT_CPLAYER, MSGL_V, "Command line:");
     for (int i = 0; i < argc; i++)
@@ -4856,6 +5617,15 @@ static int mpv_main(int argc, char *argv[])
     }
 #endif
 
+    if (opts->thumbnail_sheet && *opts->thumbnail_sheet) {
+        // No output is needed, and only keyframes are decoded.
+        m_config_set_option0(mpctx->mconfig, "vo", "null");
+        m_config_set_option0(mpctx->mconfig, "aid", "no");
+        m_config_set_option0(mpctx->mconfig, "sid", "no");
+        m_config_set_option0(mpctx->mconfig, "vd-lavc-skipframe", "nonkey");
+        m_config_set_option0(mpctx->mconfig, "vd-lavc-skiploopfilter", "all");
+    }
+
 #ifdef CONFIG_ASS
     mpctx->ass_library = mp_ass_init(opts);
 #endif
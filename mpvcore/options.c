@@ -61,6 +61,7 @@ extern const m_option_t demux_rawvideo_opts[];
 extern const m_option_t cdda_opts[];
 
 extern int sws_flags;
+extern char *sws_kernel;
 extern const char pp_help[];
 
 extern const char mp_help_text[];
@@ -400,6 +401,7 @@ const m_option_t mp_opts[] = {
     // AVI and Ogg only: (re)build index at startup
     OPT_FLAG_CONSTANTS("idx", index_mode, 0, -1, 1),
     OPT_FLAG_STORE("forceidx", index_mode, 0, 2),
+    OPT_FLAG("index-cache", index_cache, 0),
 
     // select audio/video/subtitle stream
     OPT_TRACKCHOICE("aid", audio_id),
@@ -484,6 +486,7 @@ const m_option_t mp_opts[] = {
 
     // scaling:
     {"sws", &sws_flags, CONF_TYPE_INT, 0, 0, 2, NULL},
+    {"sws-kernel", &sws_kernel, CONF_TYPE_STRING, 0, 0, 0, NULL},
     {"ssf", (void *) scaler_filter_conf, CONF_TYPE_SUBCONFIG, 0, 0, 0, NULL},
     OPT_FLOATRANGE("aspect", movie_aspect, 0, 0.1, 10.0),
     OPT_FLOAT_STORE("no-aspect", movie_aspect, 0, 0),
@@ -532,6 +535,7 @@ const m_option_t mp_opts[] = {
     OPT_STRINGLIST("ass-force-style", ass_force_style_list, 0),
     OPT_STRING("ass-styles", ass_styles_file, 0),
     OPT_INTRANGE("ass-hinting", ass_hinting, 0, 0, 7),
+    OPT_INTRANGE("ass-render-ahead", ass_render_ahead, 0, 0, 30),
     OPT_CHOICE("ass-style-override", ass_style_override, 0,
                ({"no", 0}, {"yes", 1})),
     OPT_FLAG("osd-bar", osd_bar_visible, 0),
@@ -667,6 +671,7 @@ const m_option_t mp_opts[] = {
 
     OPT_FLAG("ordered-chapters", ordered_chapters, 0),
     OPT_INTRANGE("chapter-merge-threshold", chapter_merge_threshold, 0, 0, 10000),
+    OPT_INTRANGE("timeline-max-open", timeline_max_open, 0, 0, 10000),
 
     OPT_DOUBLE("chapter-seek-threshold", chapter_seek_threshold, 0),
 
@@ -707,6 +712,11 @@ const m_option_t mp_opts[] = {
 
     {"screenshot", (void *) screenshot_conf, CONF_TYPE_SUBCONFIG},
 
+    OPT_STRING("thumbnail-sheet", thumbnail_sheet, 0),
+    OPT_INTRANGE("thumbnail-count", thumbnail_count, 0, 1, 1000),
+    OPT_INTRANGE("thumbnail-columns", thumbnail_columns, 0, 1, 100),
+    OPT_INTRANGE("thumbnail-width", thumbnail_width, 0, 16, 4096),
+
     {"", (void *) mp_input_opts, CONF_TYPE_SUBCONFIG},
 
     OPT_FLAG("list-properties", list_properties, CONF_GLOBAL),
@@ -735,6 +745,7 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("oneverdrop", encode_output.neverdrop, CONF_GLOBAL),
     OPT_FLAG("ovfirst", encode_output.video_first, CONF_GLOBAL),
     OPT_FLAG("oafirst", encode_output.audio_first, CONF_GLOBAL),
+    OPT_FLAG("ocopy", encode_output.copy, CONF_GLOBAL),
 #endif
 
     {NULL, NULL, 0, 0, 0, 0, NULL}
@@ -781,6 +792,7 @@ const struct MPOpts mp_default_opts = {
     .loop_times = -1,
     .ordered_chapters = 1,
     .chapter_merge_threshold = 100,
+    .timeline_max_open = 10,
     .chapter_seek_threshold = 5.0,
     .load_config = 1,
     .position_resume = 1,
@@ -795,6 +807,9 @@ const struct MPOpts mp_default_opts = {
     .term_osd = 2,
     .consolecontrols = 1,
     .play_frames = -1,
+    .thumbnail_count = 16,
+    .thumbnail_columns = 4,
+    .thumbnail_width = 160,
     .keep_open = 0,
     .audio_id = -1,
     .video_id = -1,
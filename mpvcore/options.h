@@ -88,6 +88,7 @@ typedef struct MPOpts {
     int shuffle;
     int ordered_chapters;
     int chapter_merge_threshold;
+    int timeline_max_open;
     double chapter_seek_threshold;
     int load_unsafe_playlists;
     int quiet;
@@ -158,9 +159,14 @@ typedef struct MPOpts {
 
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
+    char *thumbnail_sheet;
+    int thumbnail_count;
+    int thumbnail_columns;
+    int thumbnail_width;
 
     double force_fps;
     int index_mode; // -1=untouched  0=don't use index  1=use (generate) index
+    int index_cache;
 
     struct mp_chmap audio_output_channels;
     int audio_output_format;
@@ -199,6 +205,7 @@ typedef struct MPOpts {
     char *ass_styles_file;
     int ass_style_override;
     int ass_hinting;
+    int ass_render_ahead;
 
     int hwdec_api;
     char *hwdec_codecs;
@@ -210,6 +217,7 @@ typedef struct MPOpts {
         char *skip_frame_str;
         int threads;
         int bitexact;
+        int slices;
         char *avopt;
     } lavc_param;
 
@@ -267,6 +275,7 @@ typedef struct MPOpts {
         int neverdrop;
         int video_first;
         int audio_first;
+        int copy;
     } encode_output;
 } MPOpts;
 
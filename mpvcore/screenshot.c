@@ -17,12 +17,18 @@
  */
 
 #include <stdlib.h>
+#include <assert.h>
 #include <string.h>
 #include <time.h>
 
 #include "config.h"
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "osdep/io.h"
+#include "osdep/numcores.h"
 
 #include "talloc.h"
 #include "mpvcore/screenshot.h"
@@ -32,7 +38,11 @@
 #include "mpvcore/mp_msg.h"
 #include "mpvcore/mp_osd.h"
 #include "mpvcore/path.h"
+#include "mpvcore/mp_common.h"
+#include "mpvcore/mp_thread_pool.h"
+#include "mpvcore/input/input.h"
 #include "video/mp_image.h"
+#include "video/sws_utils.h"
 #include "video/decode/dec_video.h"
 #include "video/filter/vf.h"
 #include "video/out/vo.h"
@@ -44,6 +54,21 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// Maximum number of screenshots waiting for or being encoded, per thread.
+// If more are requested, screenshot_request() blocks.
+#define MAX_PENDING_PER_THREAD 2
+
+// A screenshot handed to the encoder threads.
+struct screenshot_job {
+    struct screenshot_ctx *ctx;
+    struct mp_image *image;
+    struct image_writer_opts opts;
+    char *filename;
+    bool osd;
+    // Set by the encoder thread; access only with screenshot_ctx.lock held.
+    bool done, ok;
+};
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
@@ -52,8 +77,47 @@ typedef struct screenshot_ctx {
     bool osd;
 
     int frameno;
+
+    // Encoder threads, created on first use.
+    struct mp_thread_pool *pool;
+    int max_pending;
+    // Jobs whose result hasn't been reported yet. The array is accessed by
+    // the playback thread only.
+    struct screenshot_job **jobs;
+    int num_jobs;
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // signaled when a job finishes
+#endif
 } screenshot_ctx;
 
+#if HAVE_PTHREADS
+#define LOCK(ctx) pthread_mutex_lock(&(ctx)->lock)
+#define UNLOCK(ctx) pthread_mutex_unlock(&(ctx)->lock)
+#define WAIT(ctx) pthread_cond_wait(&(ctx)->wakeup, &(ctx)->lock)
+#define SIGNAL(ctx) pthread_cond_broadcast(&(ctx)->wakeup)
+#else
+// Jobs are run synchronously, so nothing is ever waited for.
+#define LOCK(ctx) do {} while (0)
+#define UNLOCK(ctx) do {} while (0)
+#define WAIT(ctx) abort()
+#define SIGNAL(ctx) do {} while (0)
+#endif
+
+static int destroy_ctx(void *ptr)
+{
+    screenshot_ctx *ctx = ptr;
+    // Waits until all queued screenshots are written.
+    talloc_free(ctx->pool);
+    for (int n = 0; n < ctx->num_jobs; n++)
+        talloc_free(ctx->jobs[n]);
+#if HAVE_PTHREADS
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+#endif
+    return 0;
+}
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -61,6 +125,11 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+#if HAVE_PTHREADS
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
+#endif
+    talloc_set_destructor(mpctx->screenshot_ctx, destroy_ctx);
 }
 
 #define SMSG_OK 0
@@ -228,13 +297,25 @@ error_exit:
     return NULL;
 }
 
-static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
+// Whether fname is taken by an existing file or a screenshot still being
+// written. (The files of finished jobs exist already.)
+static bool fname_in_use(screenshot_ctx *ctx, const char *fname)
+{
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        if (strcmp(ctx->jobs[n]->filename, fname) == 0)
+            return true;
+    }
+    return mp_path_exists(fname);
+}
+
+static char *gen_fname(screenshot_ctx *ctx, char *template,
+                       const char *file_ext)
 {
     int sequence = 0;
     for (;;) {
         int prev_sequence = sequence;
         char *fname = create_fname(ctx->mpctx,
-                                   ctx->mpctx->opts->screenshot_template,
+                                   template,
                                    file_ext,
                                    &sequence,
                                    &ctx->frameno);
@@ -246,7 +327,7 @@ static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
             return NULL;
         }
 
-        if (!mp_path_exists(fname))
+        if (!fname_in_use(ctx, fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -278,19 +359,97 @@ static void add_subs(struct MPContext *mpctx, struct mp_image *image)
                       OSD_DRAW_SUB_ONLY, image);
 }
 
+static void encode_job(void *ptr)
+{
+    struct screenshot_job *job = ptr;
+    screenshot_ctx *ctx = job->ctx;
+
+    bool ok = write_image(job->image, &job->opts, job->filename);
+
+    LOCK(ctx);
+    job->ok = ok;
+    job->done = true;
+    SIGNAL(ctx);
+    UNLOCK(ctx);
+
+    // Make a paused playloop report the result (see screenshot_poll()).
+    mp_input_wakeup(ctx->mpctx->input);
+}
+
+// Print the results of finished encoder jobs, and free them.
+static void report_done_jobs(screenshot_ctx *ctx)
+{
+    bool old_osd = ctx->osd;
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        struct screenshot_job *job = ctx->jobs[n];
+        LOCK(ctx);
+        bool done = job->done;
+        UNLOCK(ctx);
+        if (!done)
+            continue;
+        ctx->osd = job->osd;
+        if (job->ok) {
+            screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", job->filename);
+        } else {
+            screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot '%s'!",
+                           job->filename);
+        }
+        talloc_free(job);
+        MP_TARRAY_REMOVE_AT(ctx->jobs, ctx->num_jobs, n);
+        n--;
+    }
+    ctx->osd = old_osd;
+}
+
+// Takes ownership of the image, and writes it on an encoder thread.
 static void screenshot_save(struct MPContext *mpctx, struct mp_image *image)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
 
     struct image_writer_opts *opts = mpctx->opts->screenshot_image_opts;
 
-    char *filename = gen_fname(ctx, image_writer_file_ext(opts));
-    if (filename) {
-        screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
-        if (!write_image(image, opts, filename))
-            screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
-        talloc_free(filename);
+    char *filename = gen_fname(ctx, mpctx->opts->screenshot_template,
+                               image_writer_file_ext(opts));
+    if (!filename) {
+        talloc_free(image);
+        return;
+    }
+
+    if (!ctx->pool) {
+        int threads = MPMAX(default_thread_count(), 1);
+        ctx->pool = mp_thread_pool_create(ctx, threads);
+        ctx->max_pending = threads * MAX_PENDING_PER_THREAD;
     }
+
+    // Back-pressure: if the encoder threads can't keep up, block playback
+    // instead of queuing an unbounded number of images.
+    while (1) {
+        report_done_jobs(ctx);
+        if (ctx->num_jobs < ctx->max_pending)
+            break;
+        LOCK(ctx);
+        bool any_done = false;
+        for (int n = 0; n < ctx->num_jobs; n++)
+            any_done |= ctx->jobs[n]->done;
+        if (!any_done)
+            WAIT(ctx);
+        UNLOCK(ctx);
+    }
+
+    struct screenshot_job *job = talloc_ptrtype(ctx, job);
+    *job = (struct screenshot_job) {
+        .ctx = ctx,
+        .image = talloc_steal(job, image),
+        .opts = *opts,
+        .filename = talloc_steal(job, filename),
+        .osd = ctx->osd,
+    };
+    // The option strings may change while the job is running.
+    job->opts.format = talloc_strdup(job, opts->format);
+    MP_TARRAY_APPEND(ctx, ctx->jobs, ctx->num_jobs, job);
+    mp_thread_pool_queue(ctx->pool, encode_job, job);
+
+    report_done_jobs(ctx);
 }
 
 static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode)
@@ -374,17 +533,133 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
     } else {
         screenshot_msg(ctx, SMSG_ERR, "Taking screenshot failed.");
     }
+}
 
-    talloc_free(image);
+void screenshot_flush(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    if (ctx && ctx->pool) {
+        mp_thread_pool_wait(ctx->pool);
+        report_done_jobs(ctx);
+    }
+}
+
+void screenshot_poll(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    if (ctx->num_jobs)
+        report_done_jobs(ctx);
 }
 
 void screenshot_flip(struct MPContext *mpctx)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
 
+    screenshot_poll(mpctx);
+
     if (!ctx->each_frame)
         return;
 
     ctx->each_frame = false;
     screenshot_request(mpctx, ctx->mode, true, ctx->osd);
 }
+
+// Seek to pts and return the first frame the decoder outputs after it. With
+// the keyframe seek and the decoder skipping non-keyframes, this is usually
+// the keyframe at or before pts.
+static struct mp_image *sheet_grab_frame(struct MPContext *mpctx, double pts)
+{
+    struct sh_video *sh_video = mpctx->sh_video;
+    queue_seek(mpctx, MPSEEK_ABSOLUTE, pts, -1);
+    execute_queued_seek(mpctx);
+    // Give up if a broken file never outputs a frame.
+    for (int n = 0; n < 1000; n++) {
+        struct demux_packet *pkt = demux_read_packet(sh_video->gsh);
+        if (pkt && !pkt->len) {
+            talloc_free(pkt);
+            continue;
+        }
+        // At EOF, a NULL packet drains frames buffered by the decoder.
+        struct mp_image *img = decode_video(sh_video, pkt, 0,
+                                            pkt ? pkt->pts : MP_NOPTS_VALUE);
+        bool eof = !pkt;
+        talloc_free(pkt);
+        if (img || eof)
+            return img;
+        if (mpctx->stop_play)
+            break;
+    }
+    return NULL;
+}
+
+void screenshot_write_sheet(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    struct MPOpts *opts = mpctx->opts;
+
+    if (!mpctx->sh_video || mpctx->sh_video->gsh->attached_picture) {
+        screenshot_msg(ctx, SMSG_ERR, "Thumbnail sheet: no video.");
+        return;
+    }
+    double start = get_start_time(mpctx);
+    double len = get_time_length(mpctx);
+    if (len <= 0) {
+        screenshot_msg(ctx, SMSG_ERR, "Thumbnail sheet: unknown duration.");
+        return;
+    }
+
+    int count = opts->thumbnail_count;
+    int cols = MPMIN(opts->thumbnail_columns, count);
+    int rows = (count + cols - 1) / cols;
+    int tile_w = opts->thumbnail_width & ~1;
+    int tile_h = 0;
+
+    struct mp_image *sheet = NULL;
+    struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    sws->flags = mp_sws_fast_flags;
+    int grabbed = 0;
+
+    for (int n = 0; n < count; n++) {
+        // Sample the middle of each of count equal intervals, which avoids
+        // the black frames typically found at the very start and end.
+        double pts = start + len * (n + 0.5) / count;
+        struct mp_image *img = sheet_grab_frame(mpctx, pts);
+        if (!img)
+            continue;
+        if (!sheet) {
+            int d_w = img->display_w ? img->display_w : img->w;
+            int d_h = img->display_h ? img->display_h : img->h;
+            tile_h = MPMAX((int)(tile_w * (double)d_h / d_w) & ~1, 2);
+            sheet = mp_image_alloc(IMGFMT_RGB24, cols * tile_w, rows * tile_h);
+            mp_image_clear(sheet, 0, 0, sheet->w, sheet->h);
+        }
+        int x = (n % cols) * tile_w;
+        int y = (n / cols) * tile_h;
+        struct mp_image tile = *sheet;
+        mp_image_crop(&tile, x, y, x + tile_w, y + tile_h);
+        mp_sws_scale(sws, &tile, img);
+        talloc_free(img);
+        grabbed++;
+    }
+
+    talloc_free(sws);
+
+    if (!sheet) {
+        screenshot_msg(ctx, SMSG_ERR, "Thumbnail sheet: no frames decoded.");
+        return;
+    }
+
+    struct image_writer_opts *wr_opts = opts->screenshot_image_opts;
+    char *filename = gen_fname(ctx, opts->thumbnail_sheet,
+                               image_writer_file_ext(wr_opts));
+    if (filename) {
+        screenshot_msg(ctx, SMSG_OK, "Thumbnail sheet: '%s' (%d/%d frames)",
+                       filename, grabbed, count);
+        if (!write_image(sheet, wr_opts, filename))
+            screenshot_msg(ctx, SMSG_ERR, "Error writing thumbnail sheet!");
+        talloc_free(filename);
+    }
+    talloc_free(sheet);
+}
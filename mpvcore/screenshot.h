@@ -27,6 +27,8 @@ struct MPContext;
 void screenshot_init(struct MPContext *mpctx);
 
 // Request a taking & saving a screenshot of the currently displayed frame.
+// The image is encoded and written on a background thread; the result is
+// reported on a later call (see screenshot_poll() and screenshot_flip()).
 // mode: 0: -, 1: save the actual output window contents, 2: with subtitles.
 // each_frame: If set, this toggles per-frame screenshots, exactly like the
 //             screenshot slave command (MP_CMD_SCREENSHOT).
@@ -40,6 +42,19 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
 void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
                         bool osd);
 
+// Decode opts->thumbnail_count frames evenly spread over the current file,
+// and save them as a single contact sheet image (--thumbnail-sheet).
+void screenshot_write_sheet(struct MPContext *mpctx);
+
+// Wait until all screenshots queued for encoding have been written, and
+// print the results.
+void screenshot_flush(struct MPContext *mpctx);
+
+// Print the results of screenshots that have been written since the last
+// call. Called by the playback core code while paused, as no new frames are
+// displayed then.
+void screenshot_poll(struct MPContext *mpctx);
+
 // Called by the playback core code when a new frame is displayed.
 void screenshot_flip(struct MPContext *mpctx);
 
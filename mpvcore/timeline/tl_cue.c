@@ -173,12 +173,8 @@ bool mp_probe_cue(struct bstr data)
     return valid;
 }
 
-static void add_source(struct MPContext *mpctx, struct demuxer *d)
-{
-    MP_TARRAY_APPEND(NULL, mpctx->sources, mpctx->num_sources, d);
-}
-
-static bool try_open(struct MPContext *mpctx, char *filename)
+static struct timeline_source *try_open(struct MPContext *mpctx,
+                                        char *filename)
 {
     struct bstr bfilename = bstr0(filename);
     // Avoid trying to open itself or another .cue file. Best would be
@@ -186,11 +182,12 @@ static bool try_open(struct MPContext *mpctx, char *filename)
     // API doesn't allow this without opening a full demuxer.
     if (bstr_case_endswith(bfilename, bstr0(".cue"))
         || bstrcasecmp(bstr0(mpctx->demuxer->filename), bfilename) == 0)
-        return false;
+        return NULL;
 
     struct stream *s = stream_open(filename, mpctx->opts);
     if (!s)
-        return false;
+        return NULL;
+    char *demuxer_name = NULL;
     struct demuxer *d = demux_open(s, NULL, NULL, mpctx->opts);
     // Since .bin files are raw PCM data with no headers, we have to explicitly
     // open them. Also, try to avoid to open files that are most likely not .bin
@@ -200,21 +197,25 @@ static bool try_open(struct MPContext *mpctx, char *filename)
     //       CD sector size (2352 bytes)
     if (!d && bstr_case_endswith(bfilename, bstr0(".bin"))) {
         mp_msg(MSGT_CPLAYER, MSGL_WARN, "CUE: Opening as BIN file!\n");
-        d = demux_open(s, "rawaudio", NULL, mpctx->opts);
+        demuxer_name = "rawaudio";
+        d = demux_open(s, demuxer_name, NULL, mpctx->opts);
     }
     if (d) {
-        add_source(mpctx, d);
-        return true;
+        // Reopened with the same demuxer if it's closed by the timeline code
+        struct timeline_source *src = timeline_add_source(mpctx, filename, d);
+        src->demuxer_name = demuxer_name;
+        return src;
     }
     mp_msg(MSGT_CPLAYER, MSGL_ERR, "Could not open source '%s'!\n", filename);
     free_stream(s);
-    return false;
+    return NULL;
 }
 
-static bool open_source(struct MPContext *mpctx, struct bstr filename)
+static struct timeline_source *open_source(struct MPContext *mpctx,
+                                           struct bstr filename)
 {
     void *ctx = talloc_new(NULL);
-    bool res = false;
+    struct timeline_source *res = NULL;
 
     struct bstr dirname = mp_dirname(mpctx->demuxer->filename);
 
@@ -224,10 +225,9 @@ static bool open_source(struct MPContext *mpctx, struct bstr filename)
                "CUE: Invalid audio filename in .cue file!\n");
     } else {
         char *fullname = mp_path_join(ctx, dirname, base_filename);
-        if (try_open(mpctx, fullname)) {
-            res = true;
+        res = try_open(mpctx, fullname);
+        if (res)
             goto out;
-        }
     }
 
     // Try an audio file with the same name as the .cue file (but different
@@ -249,10 +249,9 @@ static bool open_source(struct MPContext *mpctx, struct bstr filename)
             mp_msg(MSGT_CPLAYER, MSGL_WARN, "CUE: No useful audio filename "
                     "in .cue file found, trying with '%s' instead!\n",
                     dename0);
-            if (try_open(mpctx, mp_path_join(ctx, dirname, dename))) {
-                res = true;
+            res = try_open(mpctx, mp_path_join(ctx, dirname, dename));
+            if (res)
                 break;
-            }
         }
     }
     closedir(d);
@@ -356,8 +355,11 @@ void build_cue_timeline(struct MPContext *mpctx)
         }
     }
 
+    struct timeline_source **sources =
+        talloc_array_ptrtype(ctx, sources, file_count);
     for (size_t i = 0; i < file_count; i++) {
-        if (!open_source(mpctx, files[i]))
+        sources[i] = open_source(mpctx, files[i]);
+        if (!sources[i])
             goto out;
     }
 
@@ -367,12 +369,12 @@ void build_cue_timeline(struct MPContext *mpctx)
                                                     track_count);
     double starttime = 0;
     for (int i = 0; i < track_count; i++) {
-        struct demuxer *source = mpctx->sources[1 + tracks[i].source];
+        struct timeline_source *source = sources[tracks[i].source];
         double duration;
         if (i + 1 < track_count && tracks[i].source == tracks[i + 1].source) {
             duration = tracks[i + 1].start - tracks[i].start;
         } else {
-            duration = source_get_length(source);
+            duration = source_get_length(source->demuxer);
             // Two cases: 1) last track of a single-file cue, or 2) any track of
             // a multi-file cue. We need to do this for 1) only because the
             // timeline needs to be terminated with the length of the last
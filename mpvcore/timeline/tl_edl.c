@@ -345,29 +345,20 @@ void build_edl_timeline(struct MPContext *mpctx)
         }
     }
 
-    // Open source files
-
-    struct demuxer **sources = talloc_array_ptrtype(NULL, sources,
-                                                    num_sources + 1);
-    talloc_free(mpctx->sources);
-    mpctx->sources = sources;
-    sources[0] = mpctx->demuxer;
-    mpctx->num_sources = 1;
+    // Register source files; they are opened when they're first used
 
+    struct timeline_source **sources =
+        talloc_array_ptrtype(tmpmem, sources, num_sources + 1);
+    sources[0] = timeline_add_source(mpctx, mpctx->demuxer->filename,
+                                     mpctx->demuxer);
     for (int i = 0; i < num_sources; i++) {
-        struct stream *s = stream_open(edl_ids[i].filename, mpctx->opts);
-        if (!s)
-            goto openfail;
-        struct demuxer *d = demux_open(s, NULL, NULL, mpctx->opts);
-        if (!d) {
-            free_stream(s);
-        openfail:
+        char *filename = edl_ids[i].filename;
+        if (!mp_is_url(bstr0(filename)) && !mp_path_exists(filename)) {
             mp_msg(MSGT_CPLAYER, MSGL_ERR, "EDL: Could not open source "
                    "file on line %d!\n", edl_ids[i].lineno);
             goto out;
         }
-        sources[mpctx->num_sources] = d;
-        mpctx->num_sources++;
+        sources[i + 1] = timeline_add_source(mpctx, filename, NULL);
     }
 
     // Write final timeline structure
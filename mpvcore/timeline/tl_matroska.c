@@ -36,6 +36,9 @@
 #include "mpvcore/path.h"
 #include "mpvcore/bstr.h"
 #include "mpvcore/mp_common.h"
+#include "mpvcore/mp_talloc.h"
+#include "mpvcore/mp_thread_pool.h"
+#include "osdep/numcores.h"
 #include "stream/stream.h"
 
 struct find_entry {
@@ -113,94 +116,128 @@ static char **find_files(const char *original_file, const char *suffix)
     return results;
 }
 
-static int enable_cache(struct MPContext *mpctx, struct stream **stream,
-                        struct demuxer **demuxer, struct demuxer_params *params)
-{
-    struct MPOpts *opts = mpctx->opts;
-
-    if (opts->stream_cache_size <= 0)
-        return 0;
+struct segment_file {
+    char *filename;
+    off_t size;             // -1 if the file couldn't be stat()ed
+    time_t mtime;
+    unsigned char (*uids)[16];
+    int num_uids;
+};
 
-    char *filename = talloc_strdup(NULL, (*demuxer)->filename);
-    free_demuxer(*demuxer);
-    free_stream(*stream);
+struct segment_uid_cache {
+    char *directory;
+    struct segment_file **files;
+    int num_files;
+};
 
-    *stream = stream_open(filename, opts);
-    if (!*stream) {
-        talloc_free(filename);
-        return -1;
-    }
+struct probe_job {
+    struct MPOpts *opts;
+    struct segment_file *file;
+};
 
-    stream_enable_cache_percent(stream,
-                                opts->stream_cache_size,
-                                opts->stream_cache_def_size,
-                                opts->stream_cache_min_percent,
-                                opts->stream_cache_seek_min_percent);
-
-    *demuxer = demux_open(*stream, "mkv", params, opts);
-    if (!*demuxer) {
-        talloc_free(filename);
-        free_stream(*stream);
-        return -1;
+static struct segment_uid_cache *get_uid_cache(struct MPContext *mpctx,
+                                               const char *filename)
+{
+    char *directory = bstrdup0(NULL, mp_dirname(filename));
+    struct segment_uid_cache *cache = mpctx->segment_uid_cache;
+    if (!cache || strcmp(cache->directory, directory) != 0) {
+        talloc_free(cache);
+        cache = talloc_zero(mpctx, struct segment_uid_cache);
+        cache->directory = talloc_steal(cache, directory);
+        mpctx->segment_uid_cache = cache;
+    } else {
+        talloc_free(directory);
     }
-
-    talloc_free(filename);
-    return 1;
+    return cache;
 }
 
-// segment = get Nth segment of a multi-segment file
-static bool check_file_seg(struct MPContext *mpctx, struct demuxer **sources,
-                           int num_sources, unsigned char uid_map[][16],
-                           char *filename, int segment)
+static void probe_file(void *ctx)
 {
-    bool was_valid = false;
-    struct demuxer_params params = {
-        .matroska_wanted_uids = uid_map,
-        .matroska_wanted_segment = segment,
-        .matroska_was_valid = &was_valid,
-    };
-    struct stream *s = stream_open(filename, mpctx->opts);
+    struct probe_job *job = ctx;
+    struct segment_file *f = job->file;
+    struct stream *s = stream_open(f->filename, job->opts);
     if (!s)
-        return false;
-    struct demuxer *d = demux_open(s, "mkv", &params, mpctx->opts);
-
-    if (!d) {
-        free_stream(s);
-        return was_valid;
-    }
-    if (d->type == DEMUXER_TYPE_MATROSKA) {
-        for (int i = 1; i < num_sources; i++) {
-            if (sources[i])
-                continue;
-            if (!memcmp(uid_map[i], d->matroska_data.segment_uid, 16)) {
-                mp_msg(MSGT_CPLAYER, MSGL_INFO, "Match for source %d: %s\n",
-                       i, d->filename);
-
-                if (enable_cache(mpctx, &s, &d, &params) < 0)
-                    continue;
+        return;
+    f->num_uids = demux_mkv_read_segment_uids(s, f, &f->uids);
+    free_stream(s);
+}
 
-                sources[i] = d;
-                return true;
+// Get the segment UIDs of the given files. Files which are not in the cache,
+// or which changed since they were added to it, are read concurrently.
+static void probe_files(struct MPContext *mpctx, struct mp_thread_pool *pool,
+                        struct segment_uid_cache *cache, char **filenames,
+                        int num_filenames, struct segment_file **out)
+{
+    void *tmp = talloc_new(NULL);
+    for (int i = 0; i < num_filenames; i++) {
+        struct stat st;
+        bool have_stat = stat(filenames[i], &st) == 0;
+        struct segment_file *f = NULL;
+        for (int n = 0; n < cache->num_files; n++) {
+            if (!strcmp(cache->files[n]->filename, filenames[i])) {
+                f = cache->files[n];
+                break;
             }
         }
+        if (f && have_stat && f->size == st.st_size && f->mtime == st.st_mtime) {
+            out[i] = f;
+            continue;
+        }
+        if (!f) {
+            f = talloc_zero(cache, struct segment_file);
+            f->filename = talloc_strdup(f, filenames[i]);
+            MP_TARRAY_APPEND(cache, cache->files, cache->num_files, f);
+        }
+        talloc_free(f->uids);
+        f->uids = NULL;
+        f->num_uids = 0;
+        f->size = have_stat ? st.st_size : -1;
+        f->mtime = have_stat ? st.st_mtime : 0;
+        out[i] = f;
+
+        mp_msg(MSGT_CPLAYER, MSGL_V, "Checking file %s\n", f->filename);
+        struct probe_job *job = talloc_ptrtype(tmp, job);
+        *job = (struct probe_job) { .opts = mpctx->opts, .file = f };
+        mp_thread_pool_queue(pool, probe_file, job);
     }
-    free_demuxer(d);
-    free_stream(s);
-    return was_valid;
+    mp_thread_pool_wait(pool);
+    talloc_free(tmp);
 }
 
-static void check_file(struct MPContext *mpctx, struct demuxer **sources,
-                       int num_sources, unsigned char uid_map[][16],
-                       char *filename, int first)
+// The source is opened when it's first used by the timeline.
+static struct timeline_source *add_source(struct MPContext *mpctx,
+                                          char *filename, int segment,
+                                          unsigned char uid[16])
 {
-    for (int segment = first; ; segment++) {
-        if (!check_file_seg(mpctx, sources, num_sources, uid_map,
-                            filename, segment))
+    struct timeline_source *src = timeline_add_source(mpctx, filename, NULL);
+    struct demuxer_params *params = talloc_zero(src, struct demuxer_params);
+    params->matroska_wanted_uids = talloc_memdup(src, uid, 16);
+    params->matroska_wanted_segment = segment;
+    src->params = params;
+    src->demuxer_name = "mkv";
+    src->enable_cache = true;
+    return src;
+}
+
+// first = first segment of the file that can be used
+static void check_file(struct MPContext *mpctx,
+                       struct timeline_source **sources, int num_sources,
+                       unsigned char uid_map[][16],
+                       struct segment_file *f, int first)
+{
+    for (int segment = first; segment < f->num_uids; segment++) {
+        for (int i = 1; i < num_sources; i++) {
+            if (sources[i] || memcmp(uid_map[i], f->uids[segment], 16))
+                continue;
+            mp_msg(MSGT_CPLAYER, MSGL_INFO, "Match for source %d: %s\n",
+                   i, f->filename);
+            sources[i] = add_source(mpctx, f->filename, segment, uid_map[i]);
             break;
+        }
     }
 }
 
-static bool missing(struct demuxer **sources, int num_sources)
+static bool missing(struct timeline_source **sources, int num_sources)
 {
     for (int i = 0; i < num_sources; i++) {
         if (!sources[i])
@@ -210,14 +247,18 @@ static bool missing(struct demuxer **sources, int num_sources)
 }
 
 static int find_ordered_chapter_sources(struct MPContext *mpctx,
-                                        struct demuxer **sources,
+                                        struct timeline_source **sources,
                                         int num_sources,
                                         unsigned char uid_map[][16])
 {
     int num_filenames = 0;
     char **filenames = NULL;
+    struct segment_uid_cache *cache = NULL;
+    struct mp_thread_pool *pool = NULL;
     if (num_sources > 1) {
         char *main_filename = mpctx->demuxer->filename;
+        cache = get_uid_cache(mpctx, main_filename);
+        pool = mp_thread_pool_create(NULL, MPMAX(default_thread_count(), 1));
         mp_msg(MSGT_CPLAYER, MSGL_INFO, "This file references data from "
                "other sources.\n");
         if (mpctx->demuxer->stream->uncached_type != STREAMTYPE_FILE) {
@@ -230,16 +271,27 @@ static int find_ordered_chapter_sources(struct MPContext *mpctx,
             num_filenames = MP_TALLOC_ELEMS(filenames);
         }
         // Possibly get further segments appended to the first segment
-        check_file(mpctx, sources, num_sources, uid_map, main_filename, 1);
+        struct segment_file *main_file;
+        probe_files(mpctx, pool, cache, &main_filename, 1, &main_file);
+        check_file(mpctx, sources, num_sources, uid_map, main_file, 1);
     }
 
-    for (int i = 0; i < num_filenames; i++) {
+    // Files are probed in batches, so that not every file in large
+    // directories has to be read if the sources are found early.
+    int batch = pool ? mp_thread_pool_get_threads(pool) * 4 : 0;
+    struct segment_file **files = talloc_array(NULL, struct segment_file *,
+                                               MPMAX(batch, 1));
+    for (int i = 0; i < num_filenames; i += batch) {
         if (!missing(sources, num_sources))
             break;
-        mp_msg(MSGT_CPLAYER, MSGL_INFO, "Checking file %s\n", filenames[i]);
-        check_file(mpctx, sources, num_sources, uid_map, filenames[i], 0);
+        int num = MPMIN(batch, num_filenames - i);
+        probe_files(mpctx, pool, cache, filenames + i, num, files);
+        for (int n = 0; n < num && missing(sources, num_sources); n++)
+            check_file(mpctx, sources, num_sources, uid_map, files[n], 0);
     }
 
+    talloc_free(files);
+    talloc_free(pool);
     talloc_free(filenames);
     if (missing(sources, num_sources)) {
         mp_msg(MSGT_CPLAYER, MSGL_ERR, "Failed to find ordered chapter part!\n"
@@ -274,9 +326,9 @@ void build_ordered_chapter_timeline(struct MPContext *mpctx)
 
     // +1 because sources/uid_map[0] is original file even if all chapters
     // actually use other sources and need separate entries
-    struct demuxer **sources = talloc_array_ptrtype(NULL, sources,
-                                                    m->num_ordered_chapters+1);
-    sources[0] = mpctx->demuxer;
+    struct timeline_source **sources =
+        talloc_array_ptrtype(NULL, sources, m->num_ordered_chapters + 1);
+    sources[0] = timeline_add_source(mpctx, demuxer->filename, demuxer);
     unsigned char (*uid_map)[16] = talloc_array_ptrtype(NULL, uid_map,
                                                  m->num_ordered_chapters + 1);
     int num_sources = 1;
@@ -365,9 +417,7 @@ void build_ordered_chapter_timeline(struct MPContext *mpctx)
     if (missing_time)
         mp_msg(MSGT_CPLAYER, MSGL_ERR, "There are %.3f seconds missing "
                "from the timeline!\n", missing_time / 1e9);
-    talloc_free(mpctx->sources);
-    mpctx->sources = sources;
-    mpctx->num_sources = num_sources;
+    talloc_free(sources);
     mpctx->timeline = timeline;
     mpctx->num_timeline_parts = part_count;
     mpctx->num_chapters = num_chapters;
@@ -62,14 +62,26 @@ struct dec_sub {
 
     double video_fps;
     const char *charset;
+    struct mp_iconv *iconv;     // converts from charset to UTF-8, or NULL
 
     struct sd *sd[MAX_NUM_SD];
     int num_sd;
 };
 
+// Subtitle events read in advance. The packet data of all events is stored in
+// a single buffer, instead of allocating a demux_packet per event.
+struct sub_event {
+    double pts;
+    double duration;
+    int offset;                 // start of the packet data in packet_list.data
+    int len;
+};
+
 struct packet_list {
-    struct demux_packet **packets;
-    int num_packets;
+    struct sub_event *events;
+    int num_events;
+    char *data;
+    int data_len;
 };
 
 struct dec_sub *sub_create(struct MPOpts *opts)
@@ -224,11 +236,11 @@ static void decode_chain(struct sd **sd, int num_sd, struct demux_packet *packet
 }
 
 static struct demux_packet *recode_packet(struct demux_packet *in,
-                                          const char *charset)
+                                          struct mp_iconv *ic)
 {
     struct demux_packet *pkt = NULL;
     bstr in_buf = {in->buffer, in->len};
-    bstr conv = mp_iconv_to_utf8(in_buf, charset, MP_ICONV_VERBOSE);
+    bstr conv = mp_iconv_conv(ic, in_buf);
     if (conv.start && conv.start != in_buf.start) {
         pkt = talloc_ptrtype(NULL, pkt);
         talloc_steal(pkt, conv.start);
@@ -248,8 +260,8 @@ static void decode_chain_recode(struct dec_sub *sub, struct sd **sd, int num_sd,
 {
     if (num_sd > 0) {
         struct demux_packet *recoded = NULL;
-        if (sub->charset)
-            recoded = recode_packet(packet, sub->charset);
+        if (sub->iconv)
+            recoded = recode_packet(packet, sub->iconv);
         decode_chain(sd, num_sd, recoded ? recoded : packet);
         talloc_free(recoded);
     }
@@ -272,19 +284,19 @@ static const char *guess_sub_cp(struct packet_list *subs, const char *usercp)
     int sep_len = strlen(sep);
     int num_pkt = 0;
     int size = 0;
-    for (int n = 0; n < subs->num_packets; n++) {
-        struct demux_packet *pkt = subs->packets[n];
-        if (size + pkt->len > max_size)
+    for (int n = 0; n < subs->num_events; n++) {
+        struct sub_event *ev = &subs->events[n];
+        if (size + ev->len > max_size)
             break;
-        size += pkt->len + sep_len;
+        size += ev->len + sep_len;
         num_pkt++;
     }
     bstr text = {talloc_size(NULL, size), 0};
     for (int n = 0; n < num_pkt; n++) {
-        struct demux_packet *pkt = subs->packets[n];
-        memcpy(text.start + text.len, pkt->buffer, pkt->len);
-        memcpy(text.start + text.len + pkt->len, sep, sep_len);
-        text.len += pkt->len + sep_len;
+        struct sub_event *ev = &subs->events[n];
+        memcpy(text.start + text.len, subs->data + ev->offset, ev->len);
+        memcpy(text.start + text.len + ev->len, sep, sep_len);
+        text.len += ev->len + sep_len;
     }
     const char *guess = mp_charset_guess(text, usercp, 0);
     talloc_free(text.start);
@@ -293,12 +305,12 @@ static const char *guess_sub_cp(struct packet_list *subs, const char *usercp)
 
 static void multiply_timings(struct packet_list *subs, double factor)
 {
-    for (int n = 0; n < subs->num_packets; n++) {
-        struct demux_packet *pkt = subs->packets[n];
-        if (pkt->pts != MP_NOPTS_VALUE)
-            pkt->pts *= factor;
-        if (pkt->duration > 0)
-            pkt->duration *= factor;
+    for (int n = 0; n < subs->num_events; n++) {
+        struct sub_event *ev = &subs->events[n];
+        if (ev->pts != MP_NOPTS_VALUE)
+            ev->pts *= factor;
+        if (ev->duration > 0)
+            ev->duration *= factor;
     }
 }
 
@@ -314,9 +326,9 @@ static void fix_overlaps_and_gaps(struct packet_list *subs)
 {
     double threshold = 0.2;     // up to 200 ms overlaps or gaps are removed
     double keep = threshold * 2;// don't change timings if durations are smaller
-    for (int i = 0; i < subs->num_packets - 1; i++) {
-        struct demux_packet *cur = subs->packets[i];
-        struct demux_packet *next = subs->packets[i + 1];
+    for (int i = 0; i < subs->num_events - 1; i++) {
+        struct sub_event *cur = &subs->events[i];
+        struct sub_event *next = &subs->events[i + 1];
         if (cur->pts != MP_NOPTS_VALUE && cur->duration > 0 &&
             next->pts != MP_NOPTS_VALUE && next->duration > 0)
         {
@@ -340,8 +352,17 @@ static void add_sub_list(struct dec_sub *sub, int at, struct packet_list *subs)
 
     sd->no_remove_duplicates = true;
 
-    for (int n = 0; n < subs->num_packets; n++)
-        decode_chain_recode(sub, sub->sd + at, sub->num_sd - at, subs->packets[n]);
+    // Already recoded by recode_sub_list().
+    for (int n = 0; n < subs->num_events; n++) {
+        struct sub_event *ev = &subs->events[n];
+        struct demux_packet pkt = {
+            .buffer = subs->data + ev->offset,
+            .len = ev->len,
+            .pts = ev->pts,
+            .duration = ev->duration,
+        };
+        decode_chain(sub->sd + at, sub->num_sd - at, &pkt);
+    }
 
     // Hack for broken FFmpeg packet format: make sd_ass keep the subtitle
     // events on reset(), even if broken FFmpeg ASS packets were received
@@ -355,9 +376,44 @@ static void add_sub_list(struct dec_sub *sub, int at, struct packet_list *subs)
 
 static void add_packet(struct packet_list *subs, struct demux_packet *pkt)
 {
-    pkt = demux_copy_packet(pkt);
-    talloc_steal(subs, pkt);
-    MP_TARRAY_APPEND(subs, subs->packets, subs->num_packets, pkt);
+    // Keep the padding, which some decoders rely on.
+    int size = pkt->len + MP_INPUT_BUFFER_PADDING_SIZE;
+    MP_TARRAY_GROW(subs, subs->data, subs->data_len + size);
+    memcpy(subs->data + subs->data_len, pkt->buffer, pkt->len);
+    memset(subs->data + subs->data_len + pkt->len, 0,
+           MP_INPUT_BUFFER_PADDING_SIZE);
+    struct sub_event ev = {
+        .pts = pkt->pts,
+        .duration = pkt->duration,
+        .offset = subs->data_len,
+        .len = pkt->len,
+    };
+    MP_TARRAY_APPEND(subs, subs->events, subs->num_events, ev);
+    subs->data_len += size;
+}
+
+// Convert all events to UTF-8 in one go, reusing the iconv handle. Returns
+// the new list, and frees the old one.
+static struct packet_list *recode_sub_list(struct mp_iconv *ic,
+                                           struct packet_list *subs)
+{
+    struct packet_list *out = talloc_zero(NULL, struct packet_list);
+    for (int n = 0; n < subs->num_events; n++) {
+        struct sub_event *ev = &subs->events[n];
+        bstr in = {subs->data + ev->offset, ev->len};
+        bstr conv = mp_iconv_conv(ic, in);
+        struct demux_packet pkt = {
+            .buffer = conv.start ? conv.start : in.start,
+            .len = conv.start ? conv.len : in.len,
+            .pts = ev->pts,
+            .duration = ev->duration,
+        };
+        add_packet(out, &pkt);
+        if (conv.start != in.start)
+            talloc_free(conv.start);
+    }
+    talloc_free(subs);
+    return out;
 }
 
 // Read all packets from the demuxer and decode/add them. Returns false if
@@ -406,8 +462,13 @@ bool sub_read_all_packets(struct dec_sub *sub, struct sh_sub *sh)
     if (opts->sub_cp && !sh->is_utf8)
         sub->charset = guess_sub_cp(subs, opts->sub_cp);
 
-    if (sub->charset && sub->charset[0] && !mp_charset_is_utf8(sub->charset))
+    if (sub->charset && sub->charset[0] && !mp_charset_is_utf8(sub->charset)) {
         mp_msg(MSGT_OSD, MSGL_INFO, "Using subtitle charset: %s\n", sub->charset);
+        talloc_free(sub->iconv);
+        sub->iconv = mp_iconv_open(sub, sub->charset, MP_ICONV_VERBOSE);
+        if (sub->iconv)
+            subs = recode_sub_list(sub->iconv, subs);
+    }
 
     double sub_speed = 1.0;
 
@@ -430,8 +491,8 @@ bool sub_read_all_packets(struct dec_sub *sub, struct sh_sub *sh)
         // The last subtitle event in MicroDVD subs can have duration unset,
         // which means show the subtitle until end of video.
         // See FFmpeg FATE MicroDVD_capability_tester.sub
-        if (subs->num_packets) {
-            struct demux_packet *last = subs->packets[subs->num_packets - 1];
+        if (subs->num_events) {
+            struct sub_event *last = &subs->events[subs->num_events - 1];
             if (last->duration <= 0)
                 last->duration = 10; // arbitrary
         }
@@ -19,6 +19,14 @@ struct sd;
 enum sd_ctrl {
     SD_CTRL_SUB_STEP,
     SD_CTRL_SET_VIDEO_PARAMS,
+    SD_CTRL_RENDER_AHEAD,       // struct sd_render_ahead_args*
+};
+
+// SD_CTRL_RENDER_AHEAD
+// Bitmaps for the given subtitle pts and OSD resolution will be requested soon.
+struct sd_render_ahead_args {
+    struct mp_osd_res dim;
+    double pts;
 };
 
 struct dec_sub *sub_create(struct MPOpts *opts);
@@ -22,6 +22,7 @@
 #include <libavutil/common.h>
 
 #include "talloc.h"
+#include "mpvcore/mp_common.h"
 
 #include "img_convert.h"
 #include "sub.h"
@@ -30,10 +31,31 @@
 #include "video/sws_utils.h"
 #include "video/memcpy_pic.h"
 
+// Upper bound for the converted ASS image data kept by osd_conv_ass_to_rgba().
+// Regions used by the current frame are always kept, even if this is exceeded.
+#define ASS_CACHE_MAX_SIZE (8 * 1024 * 1024)
+
+// A converted bounding rectangle, addressed by the contents of the libass
+// images it was rendered from (relative to the rectangle's origin).
+struct ass_cache_entry {
+    uint64_t hash;
+    int w, h;
+    uint8_t *data;          // premultiplied BGRA, stride is w * 4
+    unsigned int last_used; // value of osd_conv_cache.ass_frame
+};
+
 struct osd_conv_cache {
     struct sub_bitmap part[MP_SUB_BB_LIST_MAX];
     struct sub_bitmap *parts;
-    void *scratch;
+    struct ass_cache_entry *ass_entries;
+    int num_ass_entries;
+    size_t ass_size;
+    unsigned int ass_frame;
+    // Content hash of each libass image last converted, and the bitmap_id it
+    // belongs to. Reused as long as libass reports that only positions changed.
+    uint64_t *ass_part_hashes;
+    int num_ass_part_hashes;
+    int ass_bitmap_id;
 };
 
 struct osd_conv_cache *osd_conv_cache_new(void)
@@ -243,6 +265,97 @@ static void draw_ass_rgba(unsigned char *src, int src_w, int src_h,
     }
 }
 
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+static uint64_t hash_bytes(uint64_t h, const uint8_t *p, int size)
+{
+    int n = 0;
+    for (; n + 8 <= size; n += 8) {
+        uint64_t v;
+        memcpy(&v, p + n, 8);
+        h = hash_mix(h, v);
+    }
+    for (; n < size; n++)
+        h = hash_mix(h, p[n]);
+    return h;
+}
+
+// Assume mp_get_sub_bb_list() never splits sub bitmaps
+// So we don't clip/adjust the size of the sub bitmap
+static bool part_in_bb(struct sub_bitmap *s, struct mp_rect bb)
+{
+    return !(s->x > bb.x1 || s->x + s->w < bb.x0 ||
+             s->y > bb.y1 || s->y + s->h < bb.y0);
+}
+
+static uint64_t hash_ass_part(struct sub_bitmap *s)
+{
+    uint64_t h = hash_mix(s->w, ((uint64_t)s->h << 32) | s->libass.color);
+    for (int y = 0; y < s->h; y++)
+        h = hash_bytes(h, (uint8_t *)s->bitmap + y * s->stride, s->w);
+    return h;
+}
+
+// Hash everything that influences the rendered contents of the given bounding
+// rectangle. The absolute position is left out, so that moving signs hit too.
+// part_hashes[n] is hash_ass_part(&src->parts[n]).
+static uint64_t hash_ass_region(struct sub_bitmaps *src, uint64_t *part_hashes,
+                                struct mp_rect bb)
+{
+    uint64_t h = hash_mix(bb.x1 - bb.x0, bb.y1 - bb.y0);
+    for (int p = 0; p < src->num_parts; p++) {
+        struct sub_bitmap *s = &src->parts[p];
+        if (!part_in_bb(s, bb))
+            continue;
+        h = hash_mix(h, (uint32_t)(s->x - bb.x0) |
+                        ((uint64_t)(uint32_t)(s->y - bb.y0) << 32));
+        h = hash_mix(h, part_hashes[p]);
+    }
+    return h;
+}
+
+// A hit is not verified against the source images. That would require keeping
+// a copy of them with each entry, and comparing them would take as long as
+// hashing them, which is avoided when only positions change. A 64 bit
+// collision between two regions that are on screen while the cache exists is
+// unlikely enough to be ignored, and would only show a wrong subtitle image.
+static struct ass_cache_entry *ass_cache_get(struct osd_conv_cache *c,
+                                             uint64_t hash, int w, int h)
+{
+    for (int n = 0; n < c->num_ass_entries; n++) {
+        struct ass_cache_entry *e = &c->ass_entries[n];
+        if (e->hash == hash && e->w == w && e->h == h)
+            return e;
+    }
+    return NULL;
+}
+
+// Evict least recently used entries until the size limit is met. Entries
+// referenced by the current frame are never removed.
+static void ass_cache_prune(struct osd_conv_cache *c)
+{
+    while (c->ass_size > ASS_CACHE_MAX_SIZE) {
+        int oldest = -1;
+        for (int n = 0; n < c->num_ass_entries; n++) {
+            struct ass_cache_entry *e = &c->ass_entries[n];
+            if (e->last_used != c->ass_frame && (oldest < 0 ||
+                e->last_used - c->ass_frame <
+                c->ass_entries[oldest].last_used - c->ass_frame))
+                oldest = n;
+        }
+        if (oldest < 0)
+            break;
+        struct ass_cache_entry *e = &c->ass_entries[oldest];
+        c->ass_size -= e->w * e->h * 4;
+        talloc_free(e->data);
+        MP_TARRAY_REMOVE_AT(c->ass_entries, c->num_ass_entries, oldest);
+    }
+}
+
 bool osd_conv_ass_to_rgba(struct osd_conv_cache *c, struct sub_bitmaps *imgs)
 {
     struct sub_bitmaps src = *imgs;
@@ -257,22 +370,20 @@ bool osd_conv_ass_to_rgba(struct osd_conv_cache *c, struct sub_bitmaps *imgs)
     imgs->parts = c->part;
     imgs->num_parts = num_bb;
 
-    size_t newsize = 0;
-    for (int n = 0; n < num_bb; n++) {
-        struct mp_rect bb = bb_list[n];
-        int w = bb.x1 - bb.x0;
-        int h = bb.y1 - bb.y0;
-        int stride = w * 4;
-        newsize += h * stride;
-    }
-
-    if (talloc_get_size(c->scratch) < newsize) {
-        talloc_free(c->scratch);
-        c->scratch = talloc_array(c, uint8_t, newsize);
+    c->ass_frame++;
+
+    // The images themselves are unchanged if libass reported at most a change
+    // of their positions. Don't hash all bitmap data again in this case.
+    if (src.bitmap_id != c->ass_bitmap_id ||
+        src.num_parts != c->num_ass_part_hashes)
+    {
+        MP_TARRAY_GROW(c, c->ass_part_hashes, src.num_parts);
+        for (int p = 0; p < src.num_parts; p++)
+            c->ass_part_hashes[p] = hash_ass_part(&src.parts[p]);
+        c->num_ass_part_hashes = src.num_parts;
+        c->ass_bitmap_id = src.bitmap_id;
     }
 
-    uint8_t *data = c->scratch;
-
     for (int n = 0; n < num_bb; n++) {
         struct mp_rect bb = bb_list[n];
         struct sub_bitmap *bmp = &c->part[n];
@@ -282,27 +393,39 @@ bool osd_conv_ass_to_rgba(struct osd_conv_cache *c, struct sub_bitmaps *imgs)
         bmp->w = bmp->dw = bb.x1 - bb.x0;
         bmp->h = bmp->dh = bb.y1 - bb.y0;
         bmp->stride = bmp->w * 4;
-        bmp->bitmap = data;
-        data += bmp->h * bmp->stride;
-
-        memset_pic(bmp->bitmap, 0, bmp->w * 4, bmp->h, bmp->stride);
 
-        for (int p = 0; p < src.num_parts; p++) {
-            struct sub_bitmap *s = &src.parts[p];
-
-            // Assume mp_get_sub_bb_list() never splits sub bitmaps
-            // So we don't clip/adjust the size of the sub bitmap
-            if (s->x > bb.x1 || s->x + s->w < bb.x0 ||
-                s->y > bb.y1 || s->y + s->h < bb.y0)
-                continue;
-
-            draw_ass_rgba(s->bitmap, s->w, s->h, s->stride,
-                          bmp->bitmap, bmp->stride,
-                          s->x - bb.x0, s->y - bb.y0,
-                          s->libass.color);
+        uint64_t hash = hash_ass_region(&src, c->ass_part_hashes, bb);
+        struct ass_cache_entry *e = ass_cache_get(c, hash, bmp->w, bmp->h);
+        if (!e) {
+            MP_TARRAY_APPEND(c, c->ass_entries, c->num_ass_entries,
+                (struct ass_cache_entry) {
+                    .hash = hash,
+                    .w = bmp->w,
+                    .h = bmp->h,
+                    .data = talloc_array(c, uint8_t, bmp->h * bmp->stride),
+                });
+            e = &c->ass_entries[c->num_ass_entries - 1];
+            c->ass_size += bmp->h * bmp->stride;
+
+            memset_pic(e->data, 0, bmp->w * 4, bmp->h, bmp->stride);
+
+            for (int p = 0; p < src.num_parts; p++) {
+                struct sub_bitmap *s = &src.parts[p];
+                if (!part_in_bb(s, bb))
+                    continue;
+
+                draw_ass_rgba(s->bitmap, s->w, s->h, s->stride,
+                              e->data, bmp->stride,
+                              s->x - bb.x0, s->y - bb.y0,
+                              s->libass.color);
+            }
         }
+        e->last_used = c->ass_frame;
+        bmp->bitmap = e->data;
     }
 
+    ass_cache_prune(c);
+
     return true;
 }
 
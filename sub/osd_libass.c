@@ -35,6 +35,7 @@ static const char osd_font_pfb[] =
 
 #include "sub/ass_mp.h"
 #include "mpvcore/options.h"
+#include "video/memcpy_pic.h"
 
 
 #define ASS_USE_OSD_FONT "{\\fnmpv-osd-symbols}"
@@ -269,6 +270,9 @@ static void get_osd_bar_box(struct osd_state *osd, struct osd_object *obj,
     *o_y = get_align(opts->osd_bar_align_y, track->PlayResY, *o_h, *o_border);
 }
 
+// The parts of the OSD bar that change with the bar value. Kept separate from
+// the rest (update_progbar_box()), so that only these have to be re-rendered
+// and uploaded while seeking.
 static void update_progbar(struct osd_state *osd, struct osd_object *obj)
 {
     float px, py, width, height, border;
@@ -279,24 +283,6 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     if (osd->progbar_type < 0)
         return;
 
-    float sx = px - border * 2 - height / 4; // includes additional spacing
-    float sy = py + height / 2;
-
-    char *text = talloc_asprintf(NULL, "{\\an6\\pos(%f,%f)}", sx, sy);
-
-    if (osd->progbar_type == 0 || osd->progbar_type >= 256) {
-        // no sym
-    } else if (osd->progbar_type >= 32) {
-        text = mp_append_utf8_buffer(text, osd->progbar_type);
-    } else {
-        text = talloc_strdup_append_buffer(text, ASS_USE_OSD_FONT);
-        text = mp_append_utf8_buffer(text, OSD_CODEPOINTS + osd->progbar_type);
-        text = talloc_strdup_append_buffer(text, "{\\r}");
-    }
-
-    add_osd_ass_event(obj->osd_track, text);
-    talloc_free(text);
-
     struct ass_draw *d = &(struct ass_draw) { .scale = 4 };
     // filled area
     d->text = talloc_asprintf_append(d->text, "{\\bord0\\pos(%f,%f)}", px, py);
@@ -316,7 +302,37 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     ass_draw_stop(d);
     add_osd_ass_event(obj->osd_track, d->text);
     ass_draw_reset(d);
+}
 
+static void update_progbar_box(struct osd_state *osd, struct osd_object *obj)
+{
+    float px, py, width, height, border;
+    get_osd_bar_box(osd, obj, &px, &py, &width, &height, &border);
+
+    clear_obj(obj);
+
+    if (osd->progbar_type < 0)
+        return;
+
+    float sx = px - border * 2 - height / 4; // includes additional spacing
+    float sy = py + height / 2;
+
+    char *text = talloc_asprintf(NULL, "{\\an6\\pos(%f,%f)}", sx, sy);
+
+    if (osd->progbar_type == 0 || osd->progbar_type >= 256) {
+        // no sym
+    } else if (osd->progbar_type >= 32) {
+        text = mp_append_utf8_buffer(text, osd->progbar_type);
+    } else {
+        text = talloc_strdup_append_buffer(text, ASS_USE_OSD_FONT);
+        text = mp_append_utf8_buffer(text, OSD_CODEPOINTS + osd->progbar_type);
+        text = talloc_strdup_append_buffer(text, "{\\r}");
+    }
+
+    add_osd_ass_event(obj->osd_track, text);
+    talloc_free(text);
+
+    struct ass_draw *d = &(struct ass_draw) { .scale = 4 };
     d->text = talloc_asprintf_append(d->text, "{\\pos(%f,%f)}", px, py);
     ass_draw_start(d);
 
@@ -386,22 +402,92 @@ static void update_object(struct osd_state *osd, struct osd_object *obj)
     case OSDTYPE_PROGBAR:
         update_progbar(osd, obj);
         break;
+    case OSDTYPE_PROGBAR_BOX:
+        update_progbar_box(osd, obj);
+        break;
     }
 }
 
-void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
-                            struct sub_bitmaps *out_imgs)
+// Return a string describing everything that affects rendering of the track.
+// If it's the same as on the last render, the old bitmaps can be reused.
+static char *get_signature(struct osd_state *osd, struct osd_object *obj)
 {
-    if (obj->force_redraw)
-        update_object(osd, obj);
+    ASS_Track *track = obj->osd_track;
+    struct mp_osd_res r = obj->vo_res;
+    char *s = talloc_asprintf(NULL, "%d %d %d %d %d %d %f %d %d %d\n",
+                              r.w, r.h, r.ml, r.mt, r.mr, r.mb, r.display_par,
+                              track->PlayResX, track->PlayResY,
+                              osd->opts->sub_pos);
+    for (int n = 0; n < track->n_styles; n++) {
+        ASS_Style *st = &track->styles[n];
+        s = talloc_asprintf_append_buffer(s,
+                "%s %f %u %u %u %u %d %f %f %f %d %d %d %d %d\n",
+                st->FontName ? st->FontName : "", st->FontSize,
+                (unsigned)st->PrimaryColour, (unsigned)st->SecondaryColour,
+                (unsigned)st->OutlineColour, (unsigned)st->BackColour,
+                st->BorderStyle, st->Outline, st->Shadow, st->Spacing,
+                st->MarginL, st->MarginR, st->MarginV, st->Alignment,
+                st->Encoding);
+#if LIBASS_VERSION >= 0x01020000
+        s = talloc_asprintf_append_buffer(s, "%f\n", st->Blur);
+#endif
+    }
+    for (int n = 0; n < track->n_events; n++) {
+        ASS_Event *event = &track->events[n];
+        s = talloc_asprintf_append_buffer(s, "%d %s\n", event->Style,
+                                          event->Text ? event->Text : "");
+    }
+    return s;
+}
 
-    *out_imgs = (struct sub_bitmaps) {0};
+// Render the track, and keep a copy of the bitmaps in obj->osd_imgs.
+static void render_object_copy(struct osd_state *osd, struct osd_object *obj)
+{
+    talloc_free(obj->osd_imgs.parts);
+    obj->osd_imgs = (struct sub_bitmaps) {0};
     if (!obj->osd_track)
         return;
 
+    struct sub_bitmaps imgs = {0};
     ass_set_frame_size(osd->osd_render, obj->vo_res.w, obj->vo_res.h);
     ass_set_aspect_ratio(osd->osd_render, obj->vo_res.display_par, 1.0);
     mp_ass_render_frame(osd->osd_render, obj->osd_track, 0,
-                        &obj->parts_cache, out_imgs);
+                        &obj->parts_cache, &imgs);
     talloc_steal(obj, obj->parts_cache);
+
+    // The libass bitmaps are valid only until the next ass_render_frame()
+    // call, and osd_render is shared by all objects.
+    struct sub_bitmap *parts = talloc_array(obj, struct sub_bitmap,
+                                            imgs.num_parts);
+    for (int n = 0; n < imgs.num_parts; n++) {
+        struct sub_bitmap *p = &parts[n];
+        *p = imgs.parts[n];
+        p->stride = p->w;
+        p->bitmap = talloc_size(parts, p->w * p->h);
+        memcpy_pic(p->bitmap, imgs.parts[n].bitmap, p->w, p->h, p->stride,
+                   imgs.parts[n].stride);
+    }
+    obj->osd_imgs = imgs;
+    obj->osd_imgs.parts = parts;
+}
+
+void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
+                            struct sub_bitmaps *out_imgs)
+{
+    bool changed = false;
+    if (obj->force_redraw) {
+        update_object(osd, obj);
+        char *sig = obj->osd_track ? get_signature(osd, obj) : NULL;
+        changed = !sig || !obj->osd_signature ||
+                  strcmp(sig, obj->osd_signature) != 0;
+        talloc_free(obj->osd_signature);
+        obj->osd_signature = talloc_steal(obj, sig);
+        if (changed)
+            render_object_copy(osd, obj);
+    }
+
+    // Unchanged objects don't have to be rendered again, and keep their IDs,
+    // so that the VOs don't need to upload or convert them again.
+    *out_imgs = obj->osd_imgs;
+    out_imgs->bitmap_id = out_imgs->bitmap_pos_id = changed;
 }
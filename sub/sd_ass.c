@@ -19,17 +19,26 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
 
 #include <libavutil/common.h>
 #include <ass/ass.h>
 
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "talloc.h"
 
 #include "mpvcore/options.h"
+#include "mpvcore/mp_talloc.h"
 #include "mpvcore/mp_common.h"
 #include "mpvcore/mp_msg.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
+#include "video/memcpy_pic.h"
 #include "sub.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
@@ -39,18 +48,85 @@
 // adjust their duration so that they will disappear with the next event.
 #define INCOMPLETE_EVENTS 0
 
+// Subtitle bitmaps rendered in advance (or for display, if render-ahead is
+// enabled). Unlike the result of ass_render_frame(), the bitmaps are owned by
+// this struct.
+struct ass_frame {
+    long long ipts;
+    struct mp_osd_res dim;
+    // Unique ID, and ID of the frame libass compared this frame to
+    int id, prev_id;
+    int changed;                // like the ass_render_frame() parameter
+    struct sub_bitmap *parts;
+    int num_parts;
+};
+
+#if HAVE_PTHREADS
+// All tracks render through the same ASS_Renderer, so this is global. It
+// protects the renderer, the ASS_Track and the sd_ass_priv fields used for
+// rendering. Held while rendering, so never hold it for longer than
+// necessary on the playback thread.
+static pthread_mutex_t renderer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct render_ahead {
+    pthread_t thread;
+
+    // Protects all fields below. Can be locked while holding renderer_lock,
+    // but not the other way around.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    int max_frames;
+    // Incremented if cached frames become invalid (e.g. new events)
+    int generation;
+    struct ass_frame **frames;
+    int num_frames;
+    // Last SD_CTRL_RENDER_AHEAD request
+    bool have_request;
+    struct mp_osd_res dim;
+    long long ipts;
+    long long frame_duration;   // estimated from requests; 0 if unknown
+};
+#endif
+
+// Track events sorted by start time, used to find the events at a given time
+// without scanning the whole track. Events are normally only appended to the
+// track, so the index is updated incrementally.
+struct event_index {
+    int num_indexed;            // track->events[0..num_indexed-1] are indexed
+    int *order;                 // event indexes, sorted by Start
+    long long *max_end;         // max_end[n] = max. end time of order[0..n]
+    int *found;                 // temporary result buffer
+};
+
 struct sd_ass_priv {
     struct ass_track *ass_track;
     bool is_converted;
     bool incomplete_event;
+    // Not a talloc child of this struct, because it's reallocated by the
+    // render-ahead thread.
     struct sub_bitmap *parts;
     bool flush_on_seek;
     char last_text[500];
     struct mp_image_params video_params;
     struct mp_image_params last_params;
+    struct event_index index;
+#if HAVE_PTHREADS
+    struct render_ahead *ahead; // NULL if disabled or stopped
+    bool ahead_failed;          // don't try to restart the thread
+#endif
+    int last_id;                // ID of the last ass_frame rendered
+    // Frame returned by the last get_bitmaps(). Not a talloc child of this
+    // struct, so that it can be replaced while the render-ahead thread runs.
+    struct ass_frame *shown;
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
+static void start_render_ahead(struct sd *sd);
+static void stop_render_ahead(struct sd *sd);
+static void lock_renderer(struct sd *sd);
+static void unlock_renderer(struct sd *sd, bool invalidate);
+static void invalidate_frames(struct sd *sd, long long start, long long end);
 
 static bool supports_format(const char *format)
 {
@@ -69,6 +145,132 @@ static void free_last_event(ASS_Track *track)
     track->n_events--;
 }
 
+// Return the position of the first event in order[0..num-1] starting after
+// ipts.
+static int index_upper_bound(struct sd_ass_priv *ctx, int num, long long ipts)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+    int lo = 0, hi = num;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (track->events[ix->order[mid]].Start <= ipts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+struct index_entry {
+    long long start;
+    int event;
+};
+
+// Order by start time, and events with the same start time in track order.
+static int cmp_index_entry(const void *p1, const void *p2)
+{
+    const struct index_entry *e1 = p1, *e2 = p2;
+    if (e1->start != e2->start)
+        return e1->start < e2->start ? -1 : 1;
+    return e1->event - e2->event;
+}
+
+// Add the events appended to the track since the last call. The new events
+// are sorted, then merged into the index. Usually they start after all
+// indexed events, so they are just appended.
+static void update_index(struct sd_ass_priv *ctx)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+    if (track->n_events < ix->num_indexed)
+        ix->num_indexed = 0;
+    int num_old = ix->num_indexed, num = track->n_events;
+    if (num_old == num)
+        return;
+    MP_TARRAY_GROW(ctx, ix->order, num - 1);
+    MP_TARRAY_GROW(ctx, ix->max_end, num - 1);
+
+    int num_new = num - num_old;
+    struct index_entry *new = talloc_array(NULL, struct index_entry, num_new);
+    for (int i = 0; i < num_new; i++) {
+        int event = num_old + i;
+        new[i] = (struct index_entry){track->events[event].Start, event};
+    }
+    qsort(new, num_new, sizeof(new[0]), cmp_index_entry);
+
+    // Merge order[pos..num_old-1] with the new events.
+    int pos = index_upper_bound(ctx, num_old, new[0].start);
+    int num_tail = num_old - pos;
+    int *tail = talloc_memdup(new, ix->order + pos, num_tail * sizeof(int));
+    int t = 0, n = 0;
+    for (int i = pos; i < num; i++) {
+        if (n == num_new || (t < num_tail &&
+            track->events[tail[t]].Start <= new[n].start))
+        {
+            ix->order[i] = tail[t++];
+        } else {
+            ix->order[i] = new[n++].event;
+        }
+    }
+    talloc_free(new);
+
+    for (int i = pos; i < num; i++) {
+        ASS_Event *event = &track->events[ix->order[i]];
+        long long end = event->Start + event->Duration;
+        ix->max_end[i] = i > 0 ? FFMAX(ix->max_end[i - 1], end) : end;
+    }
+    ix->num_indexed = num;
+}
+
+// Find all events visible at ipts. Returns the number of events, and sets
+// *out to an array of the event indexes in track order (valid until the next
+// call).
+static int find_events_at(struct sd_ass_priv *ctx, long long ipts, int **out)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+    update_index(ctx);
+    int num_found = 0;
+    int pos = index_upper_bound(ctx, ix->num_indexed, ipts);
+    for (int n = pos - 1; n >= 0 && ix->max_end[n] > ipts; n--) {
+        ASS_Event *event = &track->events[ix->order[n]];
+        if (ipts < event->Start + event->Duration)
+            MP_TARRAY_APPEND(ctx, ix->found, num_found, ix->order[n]);
+    }
+    // Found in reverse index order; restore track order.
+    for (int a = 1; a < num_found; a++) {
+        int v = ix->found[a], b = a;
+        for (; b > 0 && ix->found[b - 1] > v; b--)
+            ix->found[b] = ix->found[b - 1];
+        ix->found[b] = v;
+    }
+    *out = ix->found;
+    return num_found;
+}
+
+// Whether an event with the given start time, text and duration (ignored if
+// iduration < 0) was already added.
+static bool is_duplicate(struct sd_ass_priv *ctx, long long ipts,
+                         long long iduration, const char *text)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+    update_index(ctx);
+    for (int n = index_upper_bound(ctx, ix->num_indexed, ipts - 1);
+         n < ix->num_indexed; n++)
+    {
+        ASS_Event *event = &track->events[ix->order[n]];
+        if (event->Start != ipts)
+            break;
+        if ((iduration < 0 || event->Duration == iduration) &&
+            strcmp(event->Text, text) == 0)
+            return true;
+    }
+    return false;
+}
+
 static int init(struct sd *sd)
 {
     struct MPOpts *opts = sd->opts;
@@ -95,10 +297,13 @@ static int init(struct sd *sd)
 
     mp_ass_add_default_styles(ctx->ass_track, opts);
 
+    if (opts->ass_render_ahead > 0)
+        start_render_ahead(sd);
+
     return 0;
 }
 
-static void decode(struct sd *sd, struct demux_packet *packet)
+static void decode_locked(struct sd *sd, struct demux_packet *packet)
 {
     void *data = packet->buffer;
     int data_len = packet->len;
@@ -133,6 +338,7 @@ static void decode(struct sd *sd, struct demux_packet *packet)
             free_last_event(track);
         else
             event->Duration = ipts - event->Start;
+        ctx->index.num_indexed = 0;
     }
     // Note: we rely on there being guaranteed 0 bytes after data packets
     int len = strlen(text);
@@ -145,13 +351,9 @@ static void decode(struct sd *sd, struct demux_packet *packet)
         return;
     }
  not_all_whitespace:;
-    if (!sd->no_remove_duplicates) {
-        for (int i = 0; i < track->n_events; i++)
-            if (track->events[i].Start == ipts
-                && (duration <= 0 || track->events[i].Duration == iduration)
-                && strcmp(track->events[i].Text, text) == 0)
-                return;   // We've already added this subtitle
-    }
+    if (!sd->no_remove_duplicates &&
+        is_duplicate(ctx, ipts, duration <= 0 ? -1 : iduration, text))
+        return;   // We've already added this subtitle
     if (duration <= 0) {
         iduration = 10000;
         ctx->incomplete_event = true;
@@ -162,14 +364,8 @@ static void decode(struct sd *sd, struct demux_packet *packet)
                "duration set to 0 at pts %f, ignored\n", pts);
         return;
     }
-    if (!sd->no_remove_duplicates) {
-        for (int i = 0; i < track->n_events; i++) {
-            if (track->events[i].Start == ipts
-                && (track->events[i].Duration == iduration)
-                && strcmp(track->events[i].Text, text) == 0)
-                return;   // We've already added this subtitle
-        }
-    }
+    if (!sd->no_remove_duplicates && is_duplicate(ctx, ipts, iduration, text))
+        return;   // We've already added this subtitle
 #endif
     int eid = ass_alloc_event(track);
     ASS_Event *event = track->events + eid;
@@ -179,14 +375,38 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     event->Text = strdup(text);
 }
 
-static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, double pts,
-                        struct sub_bitmaps *res)
+static void decode(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *ctx = sd->priv;
-    struct MPOpts *opts = sd->opts;
+    ASS_Track *track = ctx->ass_track;
 
-    if (pts == MP_NOPTS_VALUE || !sd->ass_renderer)
-        return;
+    lock_renderer(sd);
+    int old_events = track->n_events;
+    decode_locked(sd, packet);
+    // Only frames at which a new event is visible change. Packets with
+    // duplicate events (e.g. after seeking) don't add any.
+    if (INCOMPLETE_EVENTS || track->n_events < old_events ||
+        strcmp(sd->codec, "ssa") == 0)
+    {
+        // Events were changed, or the packet can contain styles.
+        invalidate_frames(sd, LLONG_MIN, LLONG_MAX);
+    } else {
+        for (int n = old_events; n < track->n_events; n++) {
+            ASS_Event *event = &track->events[n];
+            invalidate_frames(sd, event->Start,
+                              event->Start + event->Duration);
+        }
+    }
+    unlock_renderer(sd, false);
+}
+
+// Render the subtitles at ipts. The bitmaps in res are owned by the renderer,
+// and are valid only until the next call.
+static void render_frame(struct sd *sd, struct mp_osd_res dim, long long ipts,
+                         struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct MPOpts *opts = sd->opts;
 
     ASS_Renderer *renderer = sd->ass_renderer;
     double scale = dim.display_par;
@@ -206,14 +426,322 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, double pts,
         ass_set_storage_size(renderer, 0, 0);
     }
 #endif
-    mp_ass_render_frame(renderer, ctx->ass_track, pts * 1000 + .5,
-                        &ctx->parts, res);
-    talloc_steal(ctx, ctx->parts);
+    mp_ass_render_frame(renderer, ctx->ass_track, ipts, &ctx->parts, res);
 
     if (!ctx->is_converted)
         mangle_colors(sd, res);
 }
 
+// Render the subtitles at ipts, and copy the result into a new ass_frame.
+static struct ass_frame *render_frame_copy(struct sd *sd, struct mp_osd_res dim,
+                                           long long ipts, int prev_id, int id)
+{
+    struct sub_bitmaps res = {0};
+    render_frame(sd, dim, ipts, &res);
+
+    struct ass_frame *f = talloc_ptrtype(NULL, f);
+    *f = (struct ass_frame) {
+        .ipts = ipts,
+        .dim = dim,
+        .id = id,
+        .prev_id = prev_id,
+        .changed = res.bitmap_id ? 2 : (res.bitmap_pos_id ? 1 : 0),
+        .parts = talloc_array(f, struct sub_bitmap, res.num_parts),
+        .num_parts = res.num_parts,
+    };
+    for (int n = 0; n < res.num_parts; n++) {
+        struct sub_bitmap *p = &f->parts[n];
+        *p = res.parts[n];
+        p->stride = p->w;
+        p->bitmap = talloc_size(f->parts, p->w * p->h);
+        memcpy_pic(p->bitmap, res.parts[n].bitmap, p->w, p->h, p->stride,
+                   res.parts[n].stride);
+    }
+    return f;
+}
+
+#if HAVE_PTHREADS
+
+static bool frame_matches(struct ass_frame *f, struct mp_osd_res dim,
+                          long long ipts)
+{
+    // Predicted frame times can be off by rounding.
+    return llabs(f->ipts - ipts) <= 1 && osd_res_equals(f->dim, dim);
+}
+
+// Must be called with ra->lock held.
+static int find_frame(struct render_ahead *ra, struct mp_osd_res dim,
+                      long long ipts)
+{
+    for (int n = 0; n < ra->num_frames; n++) {
+        if (frame_matches(ra->frames[n], dim, ipts))
+            return n;
+    }
+    return -1;
+}
+
+// Drop the frames at start <= ipts < end.
+// Must be called with ra->lock held.
+static void drop_frames(struct render_ahead *ra, long long start,
+                        long long end)
+{
+    for (int n = ra->num_frames - 1; n >= 0; n--) {
+        long long ipts = ra->frames[n]->ipts;
+        if (ipts >= start && ipts < end) {
+            talloc_free(ra->frames[n]);
+            MP_TARRAY_REMOVE_AT(ra->frames, ra->num_frames, n);
+        }
+    }
+}
+
+// Determine the next frame the render-ahead thread should render.
+// Must be called with ra->lock held.
+static bool get_wanted_frame(struct render_ahead *ra, long long *out_ipts)
+{
+    if (!ra->have_request)
+        return false;
+    for (int n = 0; n < ra->max_frames; n++) {
+        if (n > 0 && ra->frame_duration <= 0)
+            break;
+        long long ipts = ra->ipts + n * ra->frame_duration;
+        if (find_frame(ra, ra->dim, ipts) < 0) {
+            *out_ipts = ipts;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *render_ahead_thread(void *arg)
+{
+    struct sd *sd = arg;
+    struct sd_ass_priv *ctx = sd->priv;
+    struct render_ahead *ra = ctx->ahead;
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->terminate) {
+        long long ipts;
+        if (!get_wanted_frame(ra, &ipts)) {
+            pthread_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+        struct mp_osd_res dim = ra->dim;
+        pthread_mutex_unlock(&ra->lock);
+
+        pthread_mutex_lock(&renderer_lock);
+        // Events added before this point are included in the rendered frame.
+        pthread_mutex_lock(&ra->lock);
+        int generation = ra->generation;
+        pthread_mutex_unlock(&ra->lock);
+        struct ass_frame *f = render_frame_copy(sd, dim, ipts, ctx->last_id,
+                                                ctx->last_id + 1);
+        ctx->last_id = f->id;
+        pthread_mutex_unlock(&renderer_lock);
+
+        pthread_mutex_lock(&ra->lock);
+        if (generation == ra->generation && osd_res_equals(dim, ra->dim) &&
+            find_frame(ra, dim, ipts) < 0)
+        {
+            MP_TARRAY_APPEND(ra, ra->frames, ra->num_frames, f);
+            talloc_steal(ra, f);
+        } else {
+            talloc_free(f);
+        }
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static void start_render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    struct render_ahead *ra = talloc_zero(ctx, struct render_ahead);
+    ra->max_frames = sd->opts->ass_render_ahead;
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->wakeup, NULL);
+
+    ctx->ahead = ra;
+    if (pthread_create(&ra->thread, NULL, render_ahead_thread, sd)) {
+        mp_msg(MSGT_ASS, MSGL_ERR, "[ass] Could not start render-ahead "
+               "thread.\n");
+        ctx->ahead = NULL;
+        ctx->ahead_failed = true;
+        pthread_cond_destroy(&ra->wakeup);
+        pthread_mutex_destroy(&ra->lock);
+        talloc_free(ra);
+    }
+}
+
+static void stop_render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct render_ahead *ra = ctx->ahead;
+    if (!ra)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    ra->terminate = true;
+    pthread_cond_signal(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+
+    pthread_cond_destroy(&ra->wakeup);
+    pthread_mutex_destroy(&ra->lock);
+    talloc_free(ra);
+    ctx->ahead = NULL;
+}
+
+static void request_frame(struct sd *sd, struct mp_osd_res dim, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (pts == MP_NOPTS_VALUE || !sd->ass_renderer)
+        return;
+    // The thread is stopped on reset (seeking or switching tracks).
+    if (!ctx->ahead && !ctx->ahead_failed && sd->opts->ass_render_ahead > 0)
+        start_render_ahead(sd);
+    struct render_ahead *ra = ctx->ahead;
+    if (!ra)
+        return;
+    long long ipts = pts * 1000 + .5;
+
+    pthread_mutex_lock(&ra->lock);
+    if (ra->have_request) {
+        long long duration = ipts - ra->ipts;
+        if (duration > 0 && duration < 1000)
+            ra->frame_duration = duration;
+    }
+    if (!osd_res_equals(dim, ra->dim))
+        drop_frames(ra, LLONG_MIN, LLONG_MAX);
+    // Frames before the requested one won't be displayed anymore.
+    drop_frames(ra, LLONG_MIN, ipts - 1);
+    ra->have_request = true;
+    ra->dim = dim;
+    ra->ipts = ipts;
+    pthread_cond_signal(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+// Return the subtitle frame for display, either from the render-ahead cache, or
+// rendered right now. Returns NULL if render-ahead is disabled.
+static struct ass_frame *get_frame(struct sd *sd, struct mp_osd_res dim,
+                                   long long ipts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct render_ahead *ra = ctx->ahead;
+    if (!ra)
+        return NULL;
+
+    struct ass_frame *f = NULL;
+    pthread_mutex_lock(&ra->lock);
+    int index = find_frame(ra, dim, ipts);
+    if (index >= 0) {
+        f = ra->frames[index];
+        MP_TARRAY_REMOVE_AT(ra->frames, ra->num_frames, index);
+        // ra's children are changed by the render-ahead thread
+        talloc_steal(NULL, f);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    if (!f) {
+        // Too late; the render-ahead thread could render a frame for a
+        // later pts anyway. The bitmaps have to be copied, because the
+        // render-ahead thread could overwrite them while they are in use.
+        pthread_mutex_lock(&renderer_lock);
+        f = render_frame_copy(sd, dim, ipts, ctx->last_id, ctx->last_id + 1);
+        ctx->last_id = f->id;
+        pthread_mutex_unlock(&renderer_lock);
+    }
+    return f;
+}
+
+static void lock_renderer(struct sd *sd)
+{
+    pthread_mutex_lock(&renderer_lock);
+}
+
+// Drop the frames rendered in advance at start <= ipts < end. A frame that
+// is being rendered right now is dropped regardless of its time.
+// Must be called with renderer_lock held.
+static void invalidate_frames(struct sd *sd, long long start, long long end)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct render_ahead *ra = ctx->ahead;
+    if (!ra || start >= end)
+        return;
+    pthread_mutex_lock(&ra->lock);
+    ra->generation++;
+    drop_frames(ra, start, end);
+    pthread_cond_signal(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+// invalidate: drop all frames rendered in advance (e.g. the track changed)
+static void unlock_renderer(struct sd *sd, bool invalidate)
+{
+    if (invalidate)
+        invalidate_frames(sd, LLONG_MIN, LLONG_MAX);
+    pthread_mutex_unlock(&renderer_lock);
+}
+
+#else /* HAVE_PTHREADS */
+
+static void start_render_ahead(struct sd *sd)
+{
+    mp_msg(MSGT_ASS, MSGL_WARN, "[ass] --ass-render-ahead requires "
+           "threading support.\n");
+}
+
+static void stop_render_ahead(struct sd *sd) {}
+static void request_frame(struct sd *sd, struct mp_osd_res dim, double pts) {}
+static void lock_renderer(struct sd *sd) {}
+static void unlock_renderer(struct sd *sd, bool invalidate) {}
+static void invalidate_frames(struct sd *sd, long long start, long long end) {}
+
+static struct ass_frame *get_frame(struct sd *sd, struct mp_osd_res dim,
+                                   long long ipts)
+{
+    return NULL;
+}
+
+#endif /* HAVE_PTHREADS */
+
+static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, double pts,
+                        struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (pts == MP_NOPTS_VALUE || !sd->ass_renderer)
+        return;
+
+    long long ipts = pts * 1000 + .5;
+
+    struct ass_frame *f = get_frame(sd, dim, ipts);
+    if (!f) {
+        lock_renderer(sd);
+        render_frame(sd, dim, ipts, res);
+        unlock_renderer(sd, false);
+        return;
+    }
+
+    // Change detection is relative to the frame libass rendered before f, so
+    // it's valid only if that frame is also the one displayed before.
+    int changed = f->changed;
+    if (!ctx->shown || f->prev_id != ctx->shown->id)
+        changed = 2;
+    talloc_free(ctx->shown);
+    ctx->shown = f;
+
+    res->format = SUBBITMAP_LIBASS;
+    res->parts = f->parts;
+    res->num_parts = f->num_parts;
+    if (changed == 2)
+        res->bitmap_id = ++res->bitmap_pos_id;
+    else if (changed)
+        res->bitmap_pos_id++;
+}
+
 struct buf {
     char *start;
     int size;
@@ -288,20 +816,22 @@ static char *get_text(struct sd *sd, double pts)
 
     struct buf b = {ctx->last_text, sizeof(ctx->last_text) - 1};
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b.len;
-                ass_to_plaintext(&b, event->Text);
-                if (is_whitespace_only(&b.start[start], b.len - start)) {
-                    b.len = start;
-                } else {
-                    append(&b, '\n');
-                }
+    lock_renderer(sd);
+    int *events;
+    int num_events = find_events_at(ctx, ipts, &events);
+    for (int i = 0; i < num_events; ++i) {
+        ASS_Event *event = track->events + events[i];
+        if (event->Text) {
+            int start = b.len;
+            ass_to_plaintext(&b, event->Text);
+            if (is_whitespace_only(&b.start[start], b.len - start)) {
+                b.len = start;
+            } else {
+                append(&b, '\n');
             }
         }
     }
+    unlock_renderer(sd, false);
 
     b.start[b.len] = '\0';
 
@@ -320,20 +850,31 @@ static void fix_events(struct sd *sd)
 static void reset(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    // If the track is switched, the next track must not share the renderer
+    // with this thread. It's restarted by the next render-ahead request.
+    stop_render_ahead(sd);
+    lock_renderer(sd);
+    // Events might be removed and re-added without update_index() noticing.
+    if (ctx->incomplete_event || ctx->flush_on_seek)
+        ctx->index.num_indexed = 0;
     if (ctx->incomplete_event)
         free_last_event(ctx->ass_track);
     ctx->incomplete_event = false;
     if (ctx->flush_on_seek)
         ass_flush_events(ctx->ass_track);
     ctx->flush_on_seek = false;
+    unlock_renderer(sd, true);
 }
 
 static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
 
+    stop_render_ahead(sd);
     if (sd->ass_track != ctx->ass_track)
         ass_free_track(ctx->ass_track);
+    talloc_free(ctx->shown);
+    talloc_free(ctx->parts);
     talloc_free(ctx);
 }
 
@@ -343,10 +884,23 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     switch (cmd) {
     case SD_CTRL_SUB_STEP: {
         double *a = arg;
+        lock_renderer(sd);
         a[0] = ass_step_sub(ctx->ass_track, a[0] * 1000 + .5, a[1]) / 1000.0;
+        unlock_renderer(sd, false);
         return CONTROL_OK;
-    case SD_CTRL_SET_VIDEO_PARAMS:
-        ctx->video_params = *(struct mp_image_params *)arg;
+    }
+    case SD_CTRL_SET_VIDEO_PARAMS: {
+        struct mp_image_params *params = arg;
+        lock_renderer(sd);
+        bool changed = params->w != ctx->video_params.w ||
+                       params->h != ctx->video_params.h;
+        ctx->video_params = *params;
+        unlock_renderer(sd, changed);
+        return CONTROL_OK;
+    }
+    case SD_CTRL_RENDER_AHEAD: {
+        struct sd_render_ahead_args *args = arg;
+        request_frame(sd, args->dim, args->pts);
         return CONTROL_OK;
     }
     default:
@@ -72,7 +72,7 @@ const struct m_sub_options osd_style_conf = {
     .defaults = &osd_style_opts_def,
 };
 
-static bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b)
+bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b)
 {
     return a.w == b.w && a.h == b.h && a.ml == b.ml && a.mt == b.mt
         && a.mr == b.mr && a.mb == b.mb
@@ -163,15 +163,15 @@ static void render_object(struct osd_state *osd, struct osd_object *obj,
                 sub_pts -= osd->video_offset - opts->sub_delay;
             sub_get_bitmaps(osd->dec_sub, obj->vo_res, sub_pts, out_imgs);
         }
+        if (obj->force_redraw) {
+            out_imgs->bitmap_id++;
+            out_imgs->bitmap_pos_id++;
+        }
     } else {
+        // Reports a change only if the bitmaps are actually different.
         osd_object_get_bitmaps(osd, obj, out_imgs);
     }
 
-    if (obj->force_redraw) {
-        out_imgs->bitmap_id++;
-        out_imgs->bitmap_pos_id++;
-    }
-
     obj->force_redraw = false;
     obj->vo_bitmap_id += out_imgs->bitmap_id;
     obj->vo_bitmap_pos_id += out_imgs->bitmap_pos_id;
@@ -213,6 +213,25 @@ static void render_object(struct osd_state *osd, struct osd_object *obj,
         obj->cached = *out_imgs;
 }
 
+// Tell the subtitle renderer that the video frame with the given pts is going
+// to be displayed next, so that it can prepare the subtitle bitmaps for it.
+void osd_render_ahead(struct osd_state *osd, double video_pts)
+{
+    struct MPOpts *opts = osd->opts;
+    struct osd_object *obj = osd->objs[OSDTYPE_SUB];
+
+    if (!osd->render_bitmap_subs || !osd->dec_sub || osd->render_subs_in_filter)
+        return;
+    // Resolution of the last time subtitles were drawn
+    if (video_pts == MP_NOPTS_VALUE || obj->vo_res.w <= 0)
+        return;
+
+    // Must be the same as in render_object().
+    struct sd_render_ahead_args args = { .dim = obj->vo_res, .pts = video_pts };
+    args.pts -= osd->video_offset - opts->sub_delay;
+    sub_control(osd->dec_sub, SD_CTRL_RENDER_AHEAD, &args);
+}
+
 // draw_flags is a bit field of OSD_DRAW_* constants
 void osd_draw(struct osd_state *osd, struct mp_osd_res res,
               double video_pts, int draw_flags,
@@ -293,7 +312,9 @@ void osd_draw_on_image_p(struct osd_state *osd, struct mp_osd_res res,
 void osd_changed(struct osd_state *osd, int new_value)
 {
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
-        if (osd->objs[n]->type == new_value)
+        int type = osd->objs[n]->type;
+        if (type == new_value ||
+            (new_value == OSDTYPE_PROGBAR && type == OSDTYPE_PROGBAR_BOX))
             osd->objs[n]->force_redraw = true;
     }
     osd->want_redraw = true;
@@ -88,6 +88,7 @@ enum mp_osdtype {
     OSDTYPE_SUBTEXT,
 
     OSDTYPE_PROGBAR,
+    OSDTYPE_PROGBAR_BOX,    // static parts of the OSD bar (updated with it)
     OSDTYPE_OSD,
 
     MAX_OSD_PARTS
@@ -113,6 +114,8 @@ struct osd_object {
     // Internally used by osd_libass.c
     struct ass_track *osd_track;
     struct sub_bitmap *parts_cache;
+    char *osd_signature;        // track contents the bitmaps were rendered for
+    struct sub_bitmaps osd_imgs;// copy of the last rendered bitmaps
 };
 
 struct osd_state {
@@ -199,6 +202,8 @@ void osd_set_sub(struct osd_state *osd, const char *text);
 void osd_changed(struct osd_state *osd, int new_value);
 void osd_changed_all(struct osd_state *osd);
 void osd_free(struct osd_state *osd);
+void osd_render_ahead(struct osd_state *osd, double video_pts);
+bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b);
 
 enum mp_osd_draw_flags {
     OSD_DRAW_SUB_FILTER = (1 << 0),
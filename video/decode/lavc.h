@@ -33,6 +33,12 @@ typedef struct lavc_ctx {
     enum AVDiscard skip_frame;
     const char *software_fallback_decoder;
 
+    // Frame memory handed to the decoder by get_buffer2 (software decoding)
+    struct mp_image_pool *dr_pool;
+
+    // First plane of the frame draw_horiz_band last passed to the VO
+    void *slice_frame;
+
     // From VO
     struct mp_hwdec_info *hwdec_info;
 
@@ -46,6 +46,7 @@
 #include "video/img_format.h"
 #include "video/mp_image_pool.h"
 #include "video/filter/vf.h"
+#include "video/out/vo.h"
 #include "demux/stheader.h"
 #include "demux/demux_packet.h"
 #include "osdep/numcores.h"
@@ -63,9 +64,15 @@ static void init_avctx(sh_video_t *sh, const char *decoder,
                        struct vd_lavc_hwdec *hwdec);
 static void uninit_avctx(sh_video_t *sh);
 static void setup_refcounting_hw(struct AVCodecContext *s);
+#if HAVE_AVUTIL_REFCOUNTING
+static void setup_direct_rendering(struct AVCodecContext *s);
+#endif
 
 static enum PixelFormat get_format_hwdec(struct AVCodecContext *avctx,
                                          const enum PixelFormat *pix_fmt);
+static void draw_horiz_band(struct AVCodecContext *avctx, const AVFrame *src,
+                            int offset[AV_NUM_DATA_POINTERS], int y, int type,
+                            int height);
 
 static void uninit(struct sh_video *sh);
 
@@ -78,6 +85,7 @@ const m_option_t lavc_decode_opts_conf[] = {
     OPT_STRING("skipframe", lavc_param.skip_frame_str, 0),
     OPT_INTRANGE("threads", lavc_param.threads, 0, 0, 16),
     OPT_FLAG_CONSTANTS("bitexact", lavc_param.bitexact, 0, 0, CODEC_FLAG_BITEXACT),
+    OPT_FLAG("slices", lavc_param.slices, 0),
     OPT_STRING("o", lavc_param.avopt, 0),
     {NULL, NULL, 0, 0, 0, 0, NULL}
 };
@@ -207,6 +215,7 @@ static int init(sh_video_t *sh, const char *decoder)
     vd_ffmpeg_ctx *ctx;
     ctx = sh->context = talloc_zero(NULL, vd_ffmpeg_ctx);
     ctx->non_dr1_pool = talloc_steal(ctx, mp_image_pool_new(16));
+    ctx->dr_pool = talloc_steal(ctx, mp_image_pool_new(32));
 
     if (bstr_endswith0(bstr0(decoder), "_vdpau")) {
         mp_tmsg(MSGT_DECVIDEO, MSGL_WARN, "VDPAU decoder '%s' was requested. "
@@ -368,6 +377,8 @@ static void init_avctx(sh_video_t *sh, const char *decoder,
     } else {
 #if HAVE_AVUTIL_REFCOUNTING
         avctx->refcounted_frames = 1;
+        if (lavc_codec->capabilities & CODEC_CAP_DR1)
+            setup_direct_rendering(avctx);
 #else
         if (lavc_codec->capabilities & CODEC_CAP_DR1) {
             ctx->do_dr1            = true;
@@ -377,6 +388,12 @@ static void init_avctx(sh_video_t *sh, const char *decoder,
 #endif
     }
 
+    // libavcodec disables this by itself if frame threading is used.
+    if (lavc_param->slices && !ctx->hwdec) {
+        avctx->draw_horiz_band = draw_horiz_band;
+        avctx->slice_flags = 0; // display order, whole frames
+    }
+
     if (avctx->thread_count == 0) {
         int threads = default_thread_count();
         if (threads < 1) {
@@ -481,6 +498,7 @@ static int init_vo(sh_video_t *sh, AVFrame *frame)
             pix_fmt != ctx->pix_fmt || !ctx->vo_initialized)
     {
         mp_image_pool_clear(ctx->non_dr1_pool);
+        mp_image_pool_clear(ctx->dr_pool);
         ctx->vo_initialized = 0;
         mp_msg(MSGT_DECVIDEO, MSGL_V, "[ffmpeg] aspect_ratio: %f\n", aspect);
 
@@ -607,6 +625,67 @@ static void setup_refcounting_hw(AVCodecContext *avctx)
     avctx->refcounted_frames = 1;
 }
 
+// Let the decoder write directly into images allocated from ctx->dr_pool. The
+// decoded AVFrames reference these images, so they reach filters and VO
+// without any copy, and their memory is recycled through the pool.
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    sh_video_t *sh = avctx->opaque;
+    vd_ffmpeg_ctx *ctx = sh->context;
+
+    int imgfmt = pixfmt2imgfmt(pic->format);
+    if (!imgfmt || IMGFMT_IS_HWACCEL(imgfmt))
+        goto fallback;
+
+    // The decoder may write past the visible image size.
+    int w = pic->width;
+    int h = pic->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+
+    struct mp_image *img = mp_image_pool_get(ctx->dr_pool, imgfmt, w, h);
+    for (int n = 0; n < img->num_planes; n++) {
+        if (img->stride[n] % linesize_align[n]) {
+            talloc_free(img);
+            goto fallback;
+        }
+    }
+
+    // Each plane gets its own buffer, which holds a reference to the image.
+    for (int n = 0; n < MP_MAX_PLANES && img->planes[n]; n++) {
+        size_t size = n == 1 && imgfmt == IMGFMT_PAL8 ? MP_PALETTE_SIZE
+                    : (size_t)img->stride[n] * (h >> img->fmt.ys[n]);
+        struct mp_image *ref = mp_image_new_ref(img);
+        pic->data[n] = img->planes[n];
+        pic->linesize[n] = img->stride[n];
+        pic->buf[n] = av_buffer_create(img->planes[n], size, free_mpi, ref, 0);
+        if (!pic->buf[n]) {
+            talloc_free(ref);
+            talloc_free(img);
+            for (int i = 0; i < n; i++)
+                av_buffer_unref(&pic->buf[i]);
+            return -1;
+        }
+    }
+    pic->extended_data = pic->data;
+    talloc_free(img);
+
+    return 0;
+
+fallback:
+    return avcodec_default_get_buffer2(avctx, pic, flags);
+}
+
+static void setup_direct_rendering(AVCodecContext *avctx)
+{
+    avctx->get_buffer2 = get_buffer2_direct;
+    // Our buffers have no room for the edges some decoders would draw.
+    avctx->flags |= CODEC_FLAG_EMU_EDGE;
+    // mp_image_pool_get() is not thread-safe: with frame threading, have
+    // libavcodec call get_buffer2 on the decoding thread only.
+    avctx->thread_safe_callbacks = 0;
+}
+
 #else /* HAVE_AVUTIL_REFCOUNTING */
 
 static int get_buffer_hwdec(AVCodecContext *avctx, AVFrame *pic)
@@ -707,6 +786,36 @@ static struct mp_image *image_from_decoder(struct sh_video *sh)
 
 #endif /* HAVE_AVUTIL_REFCOUNTING */
 
+static void send_slice(struct sh_video *sh, struct mp_image *img,
+                       int y0, int y1)
+{
+    struct voctrl_draw_slice_args args = { .img = img, .y0 = y0, .y1 = y1 };
+    vf_control(sh->vfilter, VFCTRL_DRAW_SLICE, &args);
+}
+
+static void draw_horiz_band(struct AVCodecContext *avctx, const AVFrame *src,
+                            int offset[AV_NUM_DATA_POINTERS], int y, int type,
+                            int height)
+{
+    sh_video_t *sh = avctx->opaque;
+    vd_ffmpeg_ctx *ctx = sh->context;
+
+    // Slices can be shown early only if the decoder output goes straight to
+    // the VO. Other filters want the complete frame.
+    if (!ctx->vo_initialized || sh->vf_initialized != 1 || !sh->vfilter ||
+        sh->vfilter->next)
+        return;
+
+    struct mp_image img = {0};
+    mp_image_copy_fields_from_av_frame(&img, (AVFrame *)src);
+    if (img.imgfmt != ctx->image_params.imgfmt ||
+        img.w != ctx->image_params.w || img.h != ctx->image_params.h)
+        return;
+
+    ctx->slice_frame = img.planes[0];
+    send_slice(sh, &img, y, FFMIN(y + height, img.h));
+}
+
 static int decode(struct sh_video *sh, struct demux_packet *packet,
                   int flags, double *reordered_pts, struct mp_image **out_image)
 {
@@ -745,6 +854,12 @@ static int decode(struct sh_video *sh, struct demux_packet *packet,
     struct mp_image *mpi = image_from_decoder(sh);
     assert(mpi->planes[0]);
 
+    // If slices of a different frame were sent (e.g. the decoder gave up on
+    // a broken frame), make sure the VO doesn't confuse them with this one.
+    if (ctx->slice_frame && ctx->slice_frame != mpi->planes[0])
+        send_slice(sh, NULL, 0, 0);
+    ctx->slice_frame = NULL;
+
     if (ctx->hwdec && ctx->hwdec->process_image)
         mpi = ctx->hwdec->process_image(ctx, mpi);
 
@@ -106,6 +106,8 @@ typedef struct vf_seteq {
 /* Hack to make the OSD state object available to vf_sub which
  * access OSD/subtitle state outside of normal OSD draw time. */
 #define VFCTRL_SET_OSD_OBJ 20
+#define VFCTRL_DRAW_SLICE 21 // Decoded rows of the next frame, arg is
+                             // voctrl_draw_slice_args
 
 int vf_control(struct vf_instance *vf, int cmd, void *arg);
 
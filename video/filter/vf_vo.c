@@ -83,6 +83,11 @@ static int control(struct vf_instance *vf, int request, void *data)
         };
         return vo_control(video_out, VOCTRL_GET_EQUALIZER, &param) == VO_TRUE;
     }
+    case VFCTRL_DRAW_SLICE:
+        // If a frame is still waiting, the VO is going to draw that one first.
+        if (!video_out->config_ok || video_out->frame_loaded)
+            return CONTROL_FALSE;
+        return vo_control(video_out, VOCTRL_DRAW_SLICE, data) == VO_TRUE;
     }
     return CONTROL_UNKNOWN;
 }
@@ -255,8 +255,8 @@ const char *image_writer_file_ext(const struct image_writer_opts *opts)
     return get_writer(opts)->file_ext;
 }
 
-int write_image(struct mp_image *image, const struct image_writer_opts *opts,
-                const char *filename)
+int write_image_fp(struct mp_image *image,
+                   const struct image_writer_opts *opts, FILE *fp)
 {
     struct mp_image *allocated_image = NULL;
     struct image_writer_opts defs = image_writer_opts_defaults;
@@ -287,27 +287,35 @@ int write_image(struct mp_image *image, const struct image_writer_opts *opts,
         struct mp_image *dst = mp_image_alloc(destfmt, d_w, d_h);
         mp_image_copy_attributes(dst, image);
 
-        mp_image_swscale(dst, image, mp_sws_hq_flags);
+        mp_image_swscale_hq(dst, image);
 
         allocated_image = dst;
         image = dst;
     }
 
+    int success = writer->write(&ctx, image, fp);
+
+    talloc_free(allocated_image);
+
+    return success;
+}
+
+int write_image(struct mp_image *image, const struct image_writer_opts *opts,
+                const char *filename)
+{
     FILE *fp = fopen(filename, "wb");
     int success = 0;
     if (fp == NULL) {
         mp_msg(MSGT_CPLAYER, MSGL_ERR,
                "Error opening '%s' for writing!\n", filename);
     } else {
-        success = writer->write(&ctx, image, fp);
+        success = write_image_fp(image, opts, fp);
         success = !fclose(fp) && success;
         if (!success)
             mp_msg(MSGT_CPLAYER, MSGL_ERR, "Error writing file '%s'!\n",
                    filename);
     }
 
-    talloc_free(allocated_image);
-
     return success;
 }
 
@@ -15,6 +15,8 @@
  * with mplayer.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+
 struct mp_image;
 struct mp_csp_details;
 
@@ -50,5 +52,12 @@ const char *image_writer_file_ext(const struct image_writer_opts *opts);
 int write_image(struct mp_image *image, const struct image_writer_opts *opts,
                 const char *filename);
 
+/*
+ * Like write_image(), but write the encoded image to an already opened file,
+ * such as a pipe. The file is not closed.
+ */
+int write_image_fp(struct mp_image *image,
+                   const struct image_writer_opts *opts, FILE *fp);
+
 // Debugging helper.
 void dump_png(struct mp_image *image, const char *filename);
@@ -0,0 +1,407 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "talloc.h"
+#include "mpvcore/mp_common.h"
+#include "mpvcore/mp_thread_pool.h"
+#include "mpvcore/cpudetect.h"
+#include "osdep/numcores.h"
+#include "video/out/filter_kernels.h"
+#include "img_format.h"
+#include "mp_image.h"
+#include "kernel_scale.h"
+
+// Only use intrinsics if the compiler generates SSE2 code anyway (always the
+// case on x86_64), so that no special CFLAGS are needed for this file.
+#if HAVE_SSE2 && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SIMD 1
+#else
+#define HAVE_SIMD 0
+#endif
+
+// Filter weights are 2.14 fixed point, and sum up to 1 << WEIGHT_BITS.
+#define WEIGHT_BITS 14
+// Fractional bits of the 16 bit intermediate rows. With 8 bit input, this
+// leaves enough headroom for the overshoot of sharp filters.
+#define INTER_BITS 6
+#define V_SHIFT (WEIGHT_BITS - INTER_BITS)
+#define H_SHIFT (WEIGHT_BITS + INTER_BITS)
+
+// Coefficients of each output sample are padded to a multiple of this, so
+// that the SIMD code can process them in full vectors.
+#define TAPS_ALIGN 8
+
+// Multiply-adds per image below which threading isn't worth it.
+#define THREADED_MIN_WORK (2 * 1024 * 1024)
+#define MAX_THREADS 16
+
+#if HAVE_PTHREADS
+// Worker threads shared by all mp_kscale contexts. Created on first use, and
+// destroyed by mp_kscale_uninit_pool(). The mutex also serializes the users of
+// the pool, so that waiting for it waits only for our own slices.
+static pthread_mutex_t kscale_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct mp_thread_pool *kscale_pool;
+#endif
+
+// Filter for one dimension of one plane.
+struct scale_filter {
+    int src_size, dst_size;
+    int taps;           // number of source samples per output sample
+    int stride;         // taps, padded to TAPS_ALIGN
+    int *offset;        // [dst_size] index of the first source sample
+    int16_t *coeffs;    // [dst_size * stride] weights
+};
+
+struct mp_kscale {
+    struct filter_kernel kernel;
+    struct scale_filter h[MP_MAX_PLANES], v[MP_MAX_PLANES];
+    int16_t *rows;      // one intermediate row per job
+};
+
+struct slice_job {
+    struct scale_filter *h, *v;
+    int comps;          // interleaved components per pixel
+    uint8_t *dst;
+    ptrdiff_t dst_stride;
+    const uint8_t *src;
+    ptrdiff_t src_stride;
+    int y0, y1;         // output rows
+    int16_t *row;
+};
+
+bool mp_kscale_supported_format(int imgfmt)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    if (!desc.id || !(desc.flags & MP_IMGFLAG_BYTE_ALIGNED) ||
+        imgfmt == IMGFMT_PAL8)
+        return false;
+    if (desc.flags & MP_IMGFLAG_PLANAR) {
+        for (int n = 0; n < desc.num_planes; n++) {
+            if (desc.bytes[n] != 1)
+                return false;
+        }
+        return true;
+    }
+    return (desc.flags & MP_IMGFLAG_RGB) && desc.num_planes == 1 &&
+           (desc.bytes[0] == 3 || desc.bytes[0] == 4) &&
+           desc.plane_bits >= 24 && desc.plane_bits <= 32;
+}
+
+struct mp_kscale *mp_kscale_alloc(void *talloc_ctx, const char *kernel)
+{
+    const struct filter_kernel *k = mp_find_filter_kernel(kernel);
+    if (!k)
+        return NULL;
+    struct mp_kscale *ctx = talloc_zero(talloc_ctx, struct mp_kscale);
+    ctx->kernel = *k;
+    return ctx;
+}
+
+static void init_filter(struct mp_kscale *ctx, struct scale_filter *f,
+                        int src_size, int dst_size)
+{
+    if (f->src_size == src_size && f->dst_size == dst_size)
+        return;
+
+    struct filter_kernel k = ctx->kernel;
+    double inv_scale = src_size / (double)dst_size;
+    // Only downscaling requires widening the filter.
+    k.inv_scale = MPMAX(inv_scale, 1.0);
+    k.size = ceil(2.0 * k.radius * k.inv_scale);
+    k.size = MPMAX(k.size + (k.size & 1), 2);
+
+    bool identity = src_size == dst_size;
+    f->src_size = src_size;
+    f->dst_size = dst_size;
+    f->taps = identity ? 1 : MPMIN(k.size, src_size);
+    f->stride = (f->taps + TAPS_ALIGN - 1) & ~(TAPS_ALIGN - 1);
+    f->offset = talloc_realloc(ctx, f->offset, int, dst_size);
+    f->coeffs = talloc_realloc(ctx, f->coeffs, int16_t, dst_size * f->stride);
+    memset(f->coeffs, 0, dst_size * f->stride * sizeof(int16_t));
+
+    if (identity) {
+        for (int x = 0; x < dst_size; x++) {
+            f->offset[x] = x;
+            f->coeffs[x * f->stride] = 1 << WEIGHT_BITS;
+        }
+        return;
+    }
+
+    double *w = talloc_array(NULL, double, k.size);
+    double *folded = talloc_array(w, double, f->taps);
+    for (int x = 0; x < dst_size; x++) {
+        // Map pixel centers to each other.
+        double center = (x + 0.5) * inv_scale - 0.5;
+        double base = floor(center);
+        double frac = center - base;
+        int first = (int)base - k.size / 2 + 1;
+
+        double sum = 0;
+        for (int n = 0; n < k.size; n++) {
+            double d = fabs(frac - (n - k.size / 2 + 1)) / k.inv_scale;
+            w[n] = d < k.radius ? k.weight(&k, d) : 0;
+            sum += w[n];
+        }
+        if (sum == 0)
+            sum = 1;
+
+        // Samples outside of the image repeat the edge samples, so their
+        // weights are added to the edge sample instead.
+        int offset = MPMAX(MPMIN(first, src_size - f->taps), 0);
+        for (int n = 0; n < f->taps; n++)
+            folded[n] = 0;
+        for (int n = 0; n < k.size; n++) {
+            int pos = MPMAX(MPMIN(first + n, src_size - 1), 0);
+            folded[pos - offset] += w[n] / sum;
+        }
+
+        // Quantize, and make sure the weights sum up to exactly 1.0.
+        int16_t *c = f->coeffs + x * f->stride;
+        int total = 0, largest = 0;
+        for (int n = 0; n < f->taps; n++) {
+            c[n] = lrint(folded[n] * (1 << WEIGHT_BITS));
+            total += c[n];
+            if (c[n] > c[largest])
+                largest = n;
+        }
+        c[largest] += (1 << WEIGHT_BITS) - total;
+        f->offset[x] = offset;
+    }
+    talloc_free(w);
+}
+
+static inline uint8_t clip_uint8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+#if HAVE_SIMD
+static int filter_v_sse2(int16_t *dst, const uint8_t *src, ptrdiff_t stride,
+                         const int16_t *c, int taps, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (V_SHIFT - 1));
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i lo = round, hi = round;
+        // Interleave two source rows, so that madd applies two taps at once.
+        for (int t = 0; t < taps; t += 2) {
+            const uint8_t *p = src + t * stride + x;
+            __m128i a = _mm_loadl_epi64((const __m128i *)p);
+            __m128i b = zero;
+            uint16_t c1 = 0;
+            if (t + 1 < taps) {
+                b = _mm_loadl_epi64((const __m128i *)(p + stride));
+                c1 = c[t + 1];
+            }
+            a = _mm_unpacklo_epi8(a, zero);
+            b = _mm_unpacklo_epi8(b, zero);
+            __m128i cw = _mm_set1_epi32((uint16_t)c[t] | ((uint32_t)c1 << 16));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), cw));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), cw));
+        }
+        lo = _mm_srai_epi32(lo, V_SHIFT);
+        hi = _mm_srai_epi32(hi, V_SHIFT);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(lo, hi));
+    }
+    return x;
+}
+
+// Only for 1 component per pixel; src must be readable (but can contain
+// garbage) up to the padded filter size.
+static void filter_h_sse2(uint8_t *dst, const int16_t *src,
+                          const struct scale_filter *f)
+{
+    for (int x = 0; x < f->dst_size; x++) {
+        const int16_t *c = f->coeffs + x * f->stride;
+        const int16_t *s = src + f->offset[x];
+        __m128i sum = _mm_setzero_si128();
+        for (int t = 0; t < f->stride; t += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(s + t));
+            __m128i b = _mm_loadu_si128((const __m128i *)(c + t));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        int v = _mm_cvtsi128_si32(sum) + (1 << (H_SHIFT - 1));
+        dst[x] = clip_uint8(v >> H_SHIFT);
+    }
+}
+#endif
+
+// Vertical pass: w source bytes of the rows starting at src to one 16 bit
+// intermediate row.
+static void filter_v(int16_t *dst, const uint8_t *src, ptrdiff_t stride,
+                     const int16_t *c, int taps, int w)
+{
+    int x = 0;
+#if HAVE_SIMD
+    if (gCpuCaps.hasSSE2)
+        x = filter_v_sse2(dst, src, stride, c, taps, w);
+#endif
+    for (; x < w; x++) {
+        int sum = 1 << (V_SHIFT - 1);
+        for (int t = 0; t < taps; t++)
+            sum += src[t * stride + x] * c[t];
+        dst[x] = sum >> V_SHIFT;
+    }
+}
+
+// Horizontal pass: intermediate row to output row.
+static void filter_h(uint8_t *dst, const int16_t *src,
+                     const struct scale_filter *f, int comps)
+{
+#if HAVE_SIMD
+    if (gCpuCaps.hasSSE2 && comps == 1) {
+        filter_h_sse2(dst, src, f);
+        return;
+    }
+#endif
+    for (int x = 0; x < f->dst_size; x++) {
+        const int16_t *c = f->coeffs + x * f->stride;
+        const int16_t *s = src + f->offset[x] * comps;
+        for (int n = 0; n < comps; n++) {
+            int sum = 1 << (H_SHIFT - 1);
+            for (int t = 0; t < f->taps; t++)
+                sum += s[t * comps + n] * c[t];
+            dst[x * comps + n] = clip_uint8(sum >> H_SHIFT);
+        }
+    }
+}
+
+static void scale_slice(void *ptr)
+{
+    struct slice_job *s = ptr;
+    struct scale_filter *v = s->v;
+    int src_bytes = s->h->src_size * s->comps;
+    for (int y = s->y0; y < s->y1; y++) {
+        filter_v(s->row, s->src + v->offset[y] * s->src_stride, s->src_stride,
+                 v->coeffs + y * v->stride, v->taps, src_bytes);
+        filter_h(s->dst + y * s->dst_stride, s->row, s->h, s->comps);
+    }
+}
+
+// Lock the shared pool, and return the number of slices to use (worker
+// threads + calling thread). If the pool is busy, e.g. when scaling is done
+// on several threads at once, the caller scales on its own thread instead of
+// waiting for the others.
+static int lock_pool(void)
+{
+#if HAVE_PTHREADS
+    if (pthread_mutex_trylock(&kscale_pool_mutex) == 0) {
+        if (!kscale_pool) {
+            int threads = MPMIN(default_thread_count(), MAX_THREADS);
+            if (threads > 1)
+                kscale_pool = mp_thread_pool_create(NULL, threads - 1);
+        }
+        if (kscale_pool)
+            return mp_thread_pool_get_threads(kscale_pool) + 1;
+        pthread_mutex_unlock(&kscale_pool_mutex);
+    }
+#endif
+    return 1;
+}
+
+void mp_kscale_scale(struct mp_kscale *ctx, struct mp_image *dst,
+                     struct mp_image *src)
+{
+    assert(dst->imgfmt == src->imgfmt);
+    assert(mp_kscale_supported_format(src->imgfmt));
+
+    if (dst->w < 1 || dst->h < 1 || src->w < 1 || src->h < 1)
+        return;
+
+    bool planar = src->fmt.flags & MP_IMGFLAG_PLANAR;
+    int comps = planar ? 1 : src->fmt.bytes[0];
+
+    int64_t work = 0;
+    int max_row = 0;
+    for (int n = 0; n < src->num_planes; n++) {
+        struct scale_filter *h = &ctx->h[n], *v = &ctx->v[n];
+        init_filter(ctx, h, src->plane_w[n], dst->plane_w[n]);
+        init_filter(ctx, v, src->plane_h[n], dst->plane_h[n]);
+        work += (int64_t)v->dst_size * comps *
+                (h->src_size * v->taps + h->dst_size * h->taps);
+        // Padding for the overread of the padded horizontal filter.
+        max_row = MPMAX(max_row, h->src_size * comps + h->stride);
+    }
+
+    int slices = work >= THREADED_MIN_WORK ? lock_pool() : 1;
+    int num_jobs = slices * src->num_planes;
+    ctx->rows = talloc_realloc(ctx, ctx->rows, int16_t, num_jobs * max_row);
+    // Only the padding needs to be initialized, but it's cheap.
+    memset(ctx->rows, 0, num_jobs * max_row * sizeof(int16_t));
+
+    struct slice_job jobs[MAX_THREADS * MP_MAX_PLANES];
+    int j = 0;
+    for (int n = 0; n < src->num_planes; n++) {
+        int h = dst->plane_h[n];
+        for (int i = 0; i < slices; i++) {
+            jobs[j] = (struct slice_job) {
+                .h = &ctx->h[n],
+                .v = &ctx->v[n],
+                .comps = comps,
+                .dst = dst->planes[n],
+                .dst_stride = dst->stride[n],
+                .src = src->planes[n],
+                .src_stride = src->stride[n],
+                .y0 = (int64_t)h * i / slices,
+                .y1 = (int64_t)h * (i + 1) / slices,
+                .row = ctx->rows + j * max_row,
+            };
+            j++;
+        }
+    }
+
+#if HAVE_PTHREADS
+    if (slices > 1) {
+        // The calling thread processes the first job.
+        for (int i = 1; i < num_jobs; i++)
+            mp_thread_pool_queue(kscale_pool, scale_slice, &jobs[i]);
+        scale_slice(&jobs[0]);
+        mp_thread_pool_wait(kscale_pool);
+        pthread_mutex_unlock(&kscale_pool_mutex);
+        return;
+    }
+#endif
+    for (int i = 0; i < num_jobs; i++)
+        scale_slice(&jobs[i]);
+}
+
+void mp_kscale_uninit_pool(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&kscale_pool_mutex);
+    talloc_free(kscale_pool);
+    kscale_pool = NULL;
+    pthread_mutex_unlock(&kscale_pool_mutex);
+#endif
+}
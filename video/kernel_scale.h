@@ -0,0 +1,62 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPV_KERNEL_SCALE_H
+#define MPV_KERNEL_SCALE_H
+
+#include <stdbool.h>
+
+struct mp_image;
+
+/**
+ * Software scaler using the separable filters from filter_kernels.c (the
+ * same ones vo_opengl uses). It only scales, and doesn't convert between
+ * formats. Each plane is filtered vertically into 16 bit intermediate rows,
+ * then horizontally. Large images are split into row slices, which are
+ * processed by a pool of worker threads shared by all contexts.
+ */
+struct mp_kscale;
+
+/**
+ * Return whether the format can be scaled (8 bit planar formats, and packed
+ * RGB with 3 or 4 bytes per pixel).
+ */
+bool mp_kscale_supported_format(int imgfmt);
+
+/**
+ * Create a scaler using the named filter kernel (e.g. "lanczos3").
+ *
+ * talloc_ctx: talloc context of the newly created object
+ * kernel:     name of a filter from filter_kernels.c
+ * return:     the newly created scaler, or NULL if there is no such kernel
+ */
+struct mp_kscale *mp_kscale_alloc(void *talloc_ctx, const char *kernel);
+
+/**
+ * Scale src to dst. Both images must have the same, supported format.
+ * Filter weights are recomputed only if the image sizes change.
+ */
+void mp_kscale_scale(struct mp_kscale *ctx, struct mp_image *dst,
+                     struct mp_image *src);
+
+/**
+ * Stop the worker threads shared by all scalers. Call this on exit, when no
+ * scaler is in use anymore. The threads are started again if needed.
+ */
+void mp_kscale_uninit_pool(void);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "mpvcore/cpudetect.h"
+#include "memcpy_pic.h"
+
+// Only use intrinsics if the compiler generates SSE2 code anyway (always the
+// case on x86_64), so that no special CFLAGS are needed for this file.
+#if HAVE_SSE2 && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_STREAM_COPY 1
+#else
+#define HAVE_STREAM_COPY 0
+#endif
+
+#if HAVE_STREAM_COPY
+static void copy_line_stream(uint8_t *dst, const uint8_t *src, int len)
+{
+    // Non-temporal stores require an aligned destination.
+    int head = (-(uintptr_t)dst) & 15;
+    if (head > len)
+        head = len;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    len -= head;
+
+    int x = 0;
+    for (; x + 64 <= len; x += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + x + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + x + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + x + 48));
+        _mm_stream_si128((__m128i *)(dst + x), a);
+        _mm_stream_si128((__m128i *)(dst + x + 16), b);
+        _mm_stream_si128((__m128i *)(dst + x + 32), c);
+        _mm_stream_si128((__m128i *)(dst + x + 48), d);
+    }
+    for (; x + 16 <= len; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+        _mm_stream_si128((__m128i *)(dst + x), a);
+    }
+    memcpy(dst + x, src + x, len - x);
+}
+#endif
+
+// Like memcpy_pic(), but write the destination with non-temporal stores if
+// possible. Use this for large copies into buffers the CPU won't read back
+// soon (textures, shared memory images, frames passed to another thread), so
+// that the copy doesn't evict the working set of the caller from the cache.
+// Falls back to memcpy_pic() if there's no SSE2.
+void memcpy_pic_stream(void *dst, const void *src, int bytesPerLine,
+                       int height, int dstStride, int srcStride)
+{
+#if HAVE_STREAM_COPY
+    if (gCpuCaps.hasSSE2) {
+        for (int y = 0; y < height; y++) {
+            copy_line_stream((uint8_t *)dst + y * dstStride,
+                             (const uint8_t *)src + y * srcStride,
+                             bytesPerLine);
+        }
+        // Make the stores visible to other threads before returning.
+        _mm_sfence();
+        return;
+    }
+#endif
+    memcpy_pic(dst, src, bytesPerLine, height, dstStride, srcStride);
+}
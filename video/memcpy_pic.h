@@ -57,6 +57,9 @@ static inline void * memcpy_pic(void * dst, const void * src,
 	return retval;
 }
 
+void memcpy_pic_stream(void *dst, const void *src, int bytesPerLine,
+                       int height, int dstStride, int srcStride);
+
 static inline void memset_pic(void *dst, int fill, int bytesPerLine, int height,
                               int stride)
 {
@@ -30,6 +30,8 @@
 
 #include "talloc.h"
 
+#include "mpvcore/mp_thread_pool.h"
+#include "osdep/numcores.h"
 #include "img_format.h"
 #include "mp_image.h"
 #include "sws_utils.h"
@@ -46,6 +48,32 @@ static pthread_mutex_t refcount_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define refcount_unlock() 0
 #endif
 
+// Planes smaller than this are copied normally by mp_image_copy_stream(),
+// because they likely fit into the CPU cache anyway.
+#define COPY_STREAM_MIN_BYTES (1024 * 1024)
+// Planes larger than this are split across the copy threads.
+#define COPY_THREADED_MIN_BYTES (4 * 1024 * 1024)
+// Memory bandwidth is usually saturated with a few threads.
+#define COPY_MAX_THREADS 4
+
+#if HAVE_PTHREADS
+// Created on first use, and destroyed by mp_image_uninit_copy_pool(). The
+// mutex also serializes the users of the pool, so that waiting for it waits
+// only for our own slices.
+static pthread_mutex_t copy_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct mp_thread_pool *copy_pool;
+#endif
+
+void mp_image_uninit_copy_pool(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&copy_pool_mutex);
+    talloc_free(copy_pool);
+    copy_pool = NULL;
+    pthread_mutex_unlock(&copy_pool_mutex);
+#endif
+}
+
 struct m_refcount {
     void *arg;
     // free() is called if refcount reaches 0.
@@ -339,6 +367,87 @@ void mp_image_copy(struct mp_image *dst, struct mp_image *src)
         memcpy(dst->planes[1], src->planes[1], MP_PALETTE_SIZE);
 }
 
+struct copy_slice {
+    void *dst;
+    const void *src;
+    int line_bytes, h;
+    int dst_stride, src_stride;
+};
+
+static void copy_slice(void *ptr)
+{
+    struct copy_slice *s = ptr;
+    memcpy_pic_stream(s->dst, s->src, s->line_bytes, s->h,
+                      s->dst_stride, s->src_stride);
+}
+
+static void copy_plane_threaded(void *dst, const void *src, int line_bytes,
+                                int h, int dst_stride, int src_stride)
+{
+#if HAVE_PTHREADS
+    if ((int64_t)line_bytes * h >= COPY_THREADED_MIN_BYTES &&
+        pthread_mutex_trylock(&copy_pool_mutex) == 0)
+    {
+        if (!copy_pool) {
+            int threads = MPMIN(default_thread_count(), COPY_MAX_THREADS);
+            // The calling thread copies a slice as well.
+            if (threads > 1)
+                copy_pool = mp_thread_pool_create(NULL, threads - 1);
+        }
+        if (copy_pool) {
+            int num = mp_thread_pool_get_threads(copy_pool) + 1;
+            struct copy_slice slices[COPY_MAX_THREADS + 1];
+            int y = 0;
+            for (int n = 0; n < num; n++) {
+                int y1 = (int64_t)h * (n + 1) / num;
+                slices[n] = (struct copy_slice) {
+                    .dst = (uint8_t *)dst + (ptrdiff_t)y * dst_stride,
+                    .src = (const uint8_t *)src + (ptrdiff_t)y * src_stride,
+                    .line_bytes = line_bytes,
+                    .h = y1 - y,
+                    .dst_stride = dst_stride,
+                    .src_stride = src_stride,
+                };
+                y = y1;
+            }
+            for (int n = 1; n < num; n++)
+                mp_thread_pool_queue(copy_pool, copy_slice, &slices[n]);
+            copy_slice(&slices[0]);
+            mp_thread_pool_wait(copy_pool);
+            pthread_mutex_unlock(&copy_pool_mutex);
+            return;
+        }
+        pthread_mutex_unlock(&copy_pool_mutex);
+    }
+#endif
+    memcpy_pic_stream(dst, src, line_bytes, h, dst_stride, src_stride);
+}
+
+// Like mp_image_copy(), but intended for whole frames that are written into
+// memory the CPU won't read back soon (VO upload buffers, decoder output
+// copies). Large planes are written with non-temporal stores to avoid cache
+// pollution, and very large planes are additionally split across a small pool
+// of copy threads to use more of the available memory bandwidth.
+void mp_image_copy_stream(struct mp_image *dst, struct mp_image *src)
+{
+    assert(dst->imgfmt == src->imgfmt);
+    assert(dst->w == src->w && dst->h == src->h);
+    assert(mp_image_is_writeable(dst));
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (dst->plane_w[n] * dst->fmt.bpp[n] + 7) / 8;
+        int h = dst->plane_h[n];
+        if ((int64_t)line_bytes * h < COPY_STREAM_MIN_BYTES) {
+            memcpy_pic(dst->planes[n], src->planes[n], line_bytes, h,
+                       dst->stride[n], src->stride[n]);
+        } else {
+            copy_plane_threaded(dst->planes[n], src->planes[n], line_bytes, h,
+                                dst->stride[n], src->stride[n]);
+        }
+    }
+    if (dst->imgfmt == IMGFMT_PAL8)
+        memcpy(dst->planes[1], src->planes[1], MP_PALETTE_SIZE);
+}
+
 void mp_image_copy_attributes(struct mp_image *dst, struct mp_image *src)
 {
     dst->pict_type = src->pict_type;
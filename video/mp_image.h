@@ -110,6 +110,8 @@ typedef struct mp_image {
 
 struct mp_image *mp_image_alloc(unsigned int fmt, int w, int h);
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
+void mp_image_copy_stream(struct mp_image *dmpi, struct mp_image *mpi);
+void mp_image_uninit_copy_pool(void);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
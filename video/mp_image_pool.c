@@ -152,7 +152,7 @@ struct mp_image *mp_image_pool_new_copy(struct mp_image_pool *pool,
                                         struct mp_image *img)
 {
     struct mp_image *new = mp_image_pool_get(pool, img->imgfmt, img->w, img->h);
-    mp_image_copy(new, img);
+    mp_image_copy_stream(new, img);
     mp_image_copy_attributes(new, img);
     return new;
 }
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <libavutil/common.h>
@@ -28,6 +29,7 @@
 #include "bitmap_packer.h"
 #include "mpvcore/mp_msg.h"
 #include "mpvcore/mp_common.h"
+#include "mpvcore/mp_talloc.h"
 #include "sub/dec_sub.h"
 #include "video/memcpy_pic.h"
 
@@ -187,11 +189,15 @@ void packer_set_size(struct bitmap_packer *packer, int size)
     packer->asize = FFMAX(packer->asize * 2, size);
     talloc_free(packer->result);
     talloc_free(packer->scratch);
+    talloc_free(packer->fresh);
+    talloc_free(packer->keys);
     packer->in = talloc_realloc(packer, packer->in, struct pos, packer->asize);
     packer->result = talloc_array_ptrtype(packer, packer->result,
                                           packer->asize);
     packer->scratch = talloc_array_ptrtype(packer, packer->scratch,
                                            packer->asize + 16);
+    packer->fresh = talloc_array_ptrtype(packer, packer->fresh, packer->asize);
+    packer->keys = talloc_array_ptrtype(packer, packer->keys, packer->asize);
 }
 
 int packer_pack_from_subbitmaps(struct bitmap_packer *packer,
@@ -207,6 +213,205 @@ int packer_pack_from_subbitmaps(struct bitmap_packer *packer,
     return packer_pack(packer);
 }
 
+struct packer_slot {
+    uint64_t key;
+    struct pos size;            // including padding
+    struct pos pos;
+};
+
+// Part of the skyline: the area below y is (partially) in use in the range
+// [x, x + w).
+struct packer_segment {
+    int x, y, w;
+};
+
+static uint64_t hash_bitmap(struct sub_bitmap *s, int pixel_stride)
+{
+    uint64_t h = ((uint64_t)s->w << 32) | s->h;
+    int len = s->w * pixel_stride;
+    for (int y = 0; y < s->h; y++) {
+        uint8_t *row = (uint8_t *)s->bitmap + y * s->stride;
+        int x = 0;
+        for (; x + 8 <= len; x += 8) {
+            uint64_t v;
+            memcpy(&v, row + x, 8);
+            h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+            h ^= h >> 32;
+        }
+        for (; x < len; x++)
+            h = ((h ^ row[x]) * 0x100000001B3ULL);
+    }
+    return h;
+}
+
+static int cmp_slot(const void *pa, const void *pb)
+{
+    const struct packer_slot *a = pa, *b = pb;
+    return a->key < b->key ? -1 : (a->key > b->key ? 1 : 0);
+}
+
+static struct packer_slot *find_slot(struct bitmap_packer *packer,
+                                     uint64_t key, struct pos size)
+{
+    int lo = 0, hi = packer->num_slots;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (packer->slots[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (int n = lo; n < packer->num_slots && packer->slots[n].key == key; n++) {
+        struct packer_slot *slot = &packer->slots[n];
+        if (slot->size.x == size.x && slot->size.y == size.y)
+            return slot;
+    }
+    return NULL;
+}
+
+// Find the lowest position for a w*h rectangle on the skyline (within the
+// area w_max*h_max), and add it to the skyline. Return false if it doesn't fit.
+static bool skyline_insert(struct bitmap_packer *packer, int w, int h,
+                           int w_max, int h_max, struct pos *out)
+{
+    struct packer_segment *sky = packer->skyline;
+    int best = -1, best_y = h_max;
+    for (int i = 0; i < packer->num_skyline; i++) {
+        int x = sky[i].x;
+        if (x + w > w_max)
+            break;
+        int y = 0;
+        for (int j = i; j < packer->num_skyline && sky[j].x < x + w; j++)
+            y = FFMAX(y, sky[j].y);
+        if (y + h <= h_max && y < best_y) {
+            best = i;
+            best_y = y;
+        }
+    }
+    if (best < 0)
+        return false;
+
+    struct packer_segment seg = {sky[best].x, best_y + h, w};
+    MP_TARRAY_GROW(packer, packer->skyline, packer->num_skyline);
+    sky = packer->skyline;
+    memmove(sky + best + 1, sky + best,
+            (packer->num_skyline - best) * sizeof(sky[0]));
+    sky[best] = seg;
+    packer->num_skyline++;
+    // Cut off the segments covered by the new one.
+    int end = seg.x + seg.w;
+    int n = best + 1;
+    while (n < packer->num_skyline && sky[n].x < end) {
+        int cut = end - sky[n].x;
+        if (cut >= sky[n].w) {
+            MP_TARRAY_REMOVE_AT(sky, packer->num_skyline, n);
+        } else {
+            sky[n].x += cut;
+            sky[n].w -= cut;
+            break;
+        }
+    }
+    // Merge neighbours with the same height.
+    for (n = packer->num_skyline - 1; n > 0; n--) {
+        if (sky[n - 1].y == sky[n].y) {
+            sky[n - 1].w += sky[n].w;
+            MP_TARRAY_REMOVE_AT(sky, packer->num_skyline, n);
+        }
+    }
+    *out = (struct pos){seg.x, best_y};
+    return true;
+}
+
+// Remember the current packing for the next packer_update_from_subbitmaps().
+static void set_slots(struct bitmap_packer *packer)
+{
+    packer->num_slots = 0;
+    for (int i = 0; i < packer->count; i++) {
+        if (!packer->in[i].x || !packer->in[i].y)
+            continue;
+        struct packer_slot slot = {packer->keys[i], packer->in[i],
+                                   packer->result[i]};
+        MP_TARRAY_APPEND(packer, packer->slots, packer->num_slots, slot);
+    }
+    qsort(packer->slots, packer->num_slots, sizeof(packer->slots[0]), cmp_slot);
+}
+
+static int repack(struct bitmap_packer *packer, int format)
+{
+    int r = packer_pack(packer);
+    packer->num_slots = 0;
+    packer->num_skyline = 0;
+    if (r < 0)
+        return r;
+    for (int i = 0; i < packer->count; i++)
+        packer->fresh[i] = true;
+    set_slots(packer);
+    // The full packing fills the area row by row, so everything below
+    // used_height is considered to be in use.
+    struct packer_segment seg = {0, packer->used_height,
+                                 packer->w + packer->padding};
+    MP_TARRAY_APPEND(packer, packer->skyline, packer->num_skyline, seg);
+    packer->slots_format = format;
+    packer->slots_padding = packer->padding;
+    return r;
+}
+
+int packer_update_from_subbitmaps(struct bitmap_packer *packer,
+                                  struct sub_bitmaps *b)
+{
+    int pixel_stride = 0;
+    if (b->format == SUBBITMAP_LIBASS)
+        pixel_stride = 1;
+    if (b->format == SUBBITMAP_RGBA)
+        pixel_stride = 4;
+    if (!pixel_stride)
+        return packer_pack_from_subbitmaps(packer, b);
+
+    packer->count = 0;
+    packer_set_size(packer, b->num_parts);
+    int a = packer->padding;
+    for (int i = 0; i < b->num_parts; i++) {
+        packer->in[i] = (struct pos){b->parts[i].w + a, b->parts[i].h + a};
+        if (packer->in[i].x <= a || packer->in[i].y <= a)
+            packer->in[i] = (struct pos){0, 0};
+        packer->keys[i] = hash_bitmap(&b->parts[i], pixel_stride);
+    }
+
+    if (!packer->num_skyline || packer->slots_format != b->format ||
+        packer->slots_padding != packer->padding)
+        return repack(packer, b->format);
+
+    int w_max = packer->w + packer->padding;
+    int h_max = packer->h + packer->padding;
+    for (int i = 0; i < packer->count; i++) {
+        struct pos size = packer->in[i];
+        packer->fresh[i] = false;
+        packer->result[i] = (struct pos){0, 0};
+        if (!size.x || !size.y)
+            continue;
+        struct packer_slot *slot = find_slot(packer, packer->keys[i], size);
+        if (slot) {
+            packer->result[i] = slot->pos;
+        } else {
+            if (!skyline_insert(packer, size.x, size.y, w_max, h_max,
+                                &packer->result[i]))
+                return repack(packer, b->format);
+            packer->fresh[i] = true;
+            packer->used_width = FFMIN(FFMAX(packer->used_width,
+                                             packer->result[i].x + size.x),
+                                       packer->w);
+            packer->used_height = FFMIN(FFMAX(packer->used_height,
+                                              packer->result[i].y + size.y),
+                                        packer->h);
+        }
+    }
+    // Slots not used anymore are dropped; their area is reused only when
+    // everything is packed again.
+    set_slots(packer);
+    return 0;
+}
+
 void packer_copy_subbitmaps(struct bitmap_packer *packer, struct sub_bitmaps *b,
                             void *data, int pixel_stride, int stride)
 {
@@ -1,6 +1,9 @@
 #ifndef MPLAYER_PACK_RECTANGLES_H
 #define MPLAYER_PACK_RECTANGLES_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 struct pos {
     int x;
     int y;
@@ -17,10 +20,19 @@ struct bitmap_packer {
     struct pos *result;
     int used_width;
     int used_height;
+    // Set by packer_update_from_subbitmaps(): whether result[i] is a new
+    // position, i.e. the bitmap has to be copied to the target surface.
+    bool *fresh;
 
     // internal
     int *scratch;
     int asize;
+    uint64_t *keys;
+    struct packer_slot *slots;          // rectangles kept from previous calls
+    int num_slots;
+    struct packer_segment *skyline;     // free space for new rectangles
+    int num_skyline;
+    int slots_format, slots_padding;
 };
 
 struct ass_image;
@@ -56,6 +68,17 @@ int packer_pack(struct bitmap_packer *packer);
 int packer_pack_from_subbitmaps(struct bitmap_packer *packer,
                                 struct sub_bitmaps *b);
 
+/* Like packer_pack_from_subbitmaps(), but keep the positions of bitmaps with
+ * the same contents as bitmaps packed by the previous call, and put new
+ * bitmaps into free space. Only if they don't fit, everything is packed
+ * again. packer->fresh[i] is set for each bitmap that has to be copied to
+ * the target surface (all of them if the packing was redone). Bitmaps that
+ * were not placed at a new position don't need to be cleared or copied.
+ * Return value as with packer_pack().
+ */
+int packer_update_from_subbitmaps(struct bitmap_packer *packer,
+                                  struct sub_bitmaps *b);
+
 // Copy the (already packed) sub-bitmaps from b to the image in data.
 // data must point to an image that is at least (packer->w, packer->h) big.
 // The image has the given stride (bytes between (x, y) to (x, y + 1)), and the
@@ -117,6 +117,9 @@ static const struct feature features[] = {
     {MPGL_CAP_SRGB_FB,          "sRGB framebuffers"},
     {MPGL_CAP_FLOAT_TEX,        "Float textures"},
     {MPGL_CAP_TEX_RG,           "RG textures"},
+    {MPGL_CAP_MAP_RANGE,        "Buffer range mapping"},
+    {MPGL_CAP_SYNC,             "Sync objects"},
+    {MPGL_CAP_PROGRAM_BINARY,   "Program binaries"},
     {MPGL_CAP_NO_SW,            "NO_SW"},
     {0},
 };
@@ -352,6 +355,40 @@ struct gl_functions gl_functions[] = {
         .provides = MPGL_CAP_TEX_RG,
         .functions = (struct gl_function[]) {{0}},
     },
+    // Mapping parts of buffers, extension in GL 2.x, core in GL 3.x core.
+    {
+        .ver_core = MPGL_VER(3, 0),
+        .extension = "GL_ARB_map_buffer_range",
+        .provides = MPGL_CAP_MAP_RANGE,
+        .functions = (struct gl_function[]) {
+            DEF_FN(MapBufferRange),
+            {0}
+        },
+    },
+    // Fences, extension in GL 2.x, core in GL 3.2 core.
+    {
+        .ver_core = MPGL_VER(3, 2),
+        .extension = "GL_ARB_sync",
+        .provides = MPGL_CAP_SYNC,
+        .functions = (struct gl_function[]) {
+            DEF_FN(FenceSync),
+            DEF_FN(ClientWaitSync),
+            DEF_FN(DeleteSync),
+            {0}
+        },
+    },
+    // Retrieving linked programs, extension in GL 3.x, core in GL 4.1.
+    {
+        .ver_core = MPGL_VER(4, 1),
+        .extension = "GL_ARB_get_program_binary",
+        .provides = MPGL_CAP_PROGRAM_BINARY,
+        .functions = (struct gl_function[]) {
+            DEF_FN(GetProgramBinary),
+            DEF_FN(ProgramBinary),
+            DEF_FN(ProgramParameteri),
+            {0}
+        },
+    },
     // Swap control, always an OS specific extension
     {
         .extension = "_swap_control",
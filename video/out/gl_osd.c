@@ -128,11 +128,13 @@ static bool upload_pbo(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
     return success;
 }
 
+// all: if false, upload only the bitmaps at new positions (packer->fresh)
 static void upload_tex(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
-                       struct sub_bitmaps *imgs)
+                       struct sub_bitmaps *imgs, bool all)
 {
     struct osd_fmt_entry fmt = ctx->fmt_table[imgs->format];
-    if (osd->packer->padding) {
+    int padding = osd->packer->padding;
+    if (padding && all) {
         struct pos bb[2];
         packer_get_bb(osd->packer, bb);
         glClearTex(ctx->gl, GL_TEXTURE_2D, fmt.format, fmt.type,
@@ -143,6 +145,14 @@ static void upload_tex(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
         struct sub_bitmap *s = &imgs->parts[n];
         struct pos p = osd->packer->result[n];
 
+        if (!all && !osd->packer->fresh[n])
+            continue;
+        if (padding && !all) {
+            glClearTex(ctx->gl, GL_TEXTURE_2D, fmt.format, fmt.type, p.x, p.y,
+                       FFMIN(s->w + padding, osd->w - p.x),
+                       FFMIN(s->h + padding, osd->h - p.y),
+                       0, &ctx->scratch);
+        }
         glUploadTex(ctx->gl, GL_TEXTURE_2D, fmt.format, fmt.type,
                     s->bitmap, s->stride, p.x, p.y, s->w, s->h, 0);
     }
@@ -155,7 +165,7 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
 
     // assume 2x2 filter on scaling
     osd->packer->padding = ctx->scaled || imgs->scaled;
-    int r = packer_pack_from_subbitmaps(osd->packer, imgs);
+    int r = packer_update_from_subbitmaps(osd->packer, imgs);
     if (r < 0) {
         mp_msg(MSGT_VO, MSGL_ERR, "[gl] OSD bitmaps do not fit on "
                "a surface with the maximum supported size %dx%d.\n",
@@ -171,9 +181,16 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
 
     gl->BindTexture(GL_TEXTURE_2D, osd->texture);
 
+    // Bitmaps that kept their position from the previous upload are still in
+    // the texture, unless the packing was redone.
+    bool all = true;
+    for (int n = 0; n < osd->packer->count; n++)
+        all &= osd->packer->fresh[n];
+
     if (osd->packer->w > osd->w || osd->packer->h > osd->h
         || osd->format != imgs->format)
     {
+        all = true;
         osd->format = imgs->format;
         osd->w = FFMAX(32, osd->packer->w);
         osd->h = FFMAX(32, osd->packer->h);
@@ -192,10 +209,10 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
     }
 
     bool uploaded = false;
-    if (ctx->use_pbo)
+    if (ctx->use_pbo && all)
         uploaded = upload_pbo(ctx, osd, imgs);
     if (!uploaded)
-        upload_tex(ctx, osd, imgs);
+        upload_tex(ctx, osd, imgs, all);
 
     gl->BindTexture(GL_TEXTURE_2D, 0);
 
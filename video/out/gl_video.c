@@ -22,8 +22,10 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 #include <assert.h>
 
 #include <libavutil/common.h>
@@ -31,6 +33,8 @@
 #include "gl_video.h"
 
 #include "mpvcore/bstr.h"
+#include "mpvcore/path.h"
+#include "stream/stream.h"
 #include "gl_common.h"
 #include "gl_osd.h"
 #include "filter_kernels.h"
@@ -47,6 +51,10 @@ static const char vo_opengl_shaders[] =
 // Pixel width of 1D lookup textures.
 #define LOOKUP_TEXTURE_SIZE 256
 
+// Maximum number of linked programs and scaler LUTs kept around for reuse.
+#define PROGRAM_CACHE_SIZE 32
+#define LUT_CACHE_SIZE 8
+
 // Texture units 0-2 are used by the video, with unit 0 for free use.
 // Units 3-4 are used for scaler LUTs.
 #define TEXUNIT_SCALERS 3
@@ -99,6 +107,13 @@ struct vertex {
 // (GL_QUAD is deprecated, strips can't be used with OSD image lists)
 #define VERTICES_PER_QUAD 6
 
+// Number of PBOs per plane used for uploading video frames. While the GPU
+// still reads from one of them, the next frame can be written to another.
+#define NUM_PBOS 3
+
+// Max. time to wait for the GPU to release a PBO (in nanoseconds).
+#define PBO_FENCE_TIMEOUT 1000000000ULL
+
 struct texplane {
     int w, h;
     int tex_w, tex_h;
@@ -106,14 +121,22 @@ struct texplane {
     GLenum gl_format;
     GLenum gl_type;
     GLuint gl_texture;
-    int gl_buffer;
-    int buffer_size;
-    void *buffer_ptr;
+    GLuint gl_buffers[NUM_PBOS];
+    int buffer_sizes[NUM_PBOS];
+    void *buffer_ptr;           // mapped gl_buffers[pbo_index], or NULL
 };
 
 struct video_image {
     struct texplane planes[4];
     bool image_flipped;
+    // PBO ring: the buffers with this index are written next
+    int pbo_index;
+    // Signaled once the GPU has finished reading the PBOs with the same index
+    GLsync pbo_fences[NUM_PBOS];
+    // Frame whose first slice_rows rows are already in the mapped PBOs
+    // (identified by its first plane)
+    void *slice_image;
+    int slice_rows;
 };
 
 struct scaler {
@@ -128,6 +151,19 @@ struct scaler {
     struct filter_kernel kernel_storage;
 };
 
+struct program_cache_entry {
+    char *key;                  // complete shader source
+    GLuint program;
+};
+
+struct lut_cache_entry {
+    const char *name;
+    float params[2];
+    int size;
+    double inv_scale;
+    float *weights;             // LOOKUP_TEXTURE_SIZE * size entries
+};
+
 struct fbotex {
     GLuint fbo;
     GLuint texture;
@@ -201,6 +237,13 @@ struct gl_video {
     int last_dither_matrix_size;
     float *last_dither_matrix;
 
+    // Linked programs and scaler weights from previous reinit_rendering()
+    // calls, least recently used first.
+    struct program_cache_entry *program_cache;
+    int num_program_cache;
+    struct lut_cache_entry *lut_cache;
+    int num_lut_cache;
+
     void *scratch;
 };
 
@@ -320,6 +363,7 @@ const struct m_sub_options gl_video_conf = {
                     {"center", MP_CHROMA_CENTER},
                     {"left",   MP_CHROMA_LEFT})),
         OPT_FLAG("alpha", enable_alpha, 0),
+        OPT_STRING("shader-cache", shader_cache, 0),
         {0}
     },
     .size = sizeof(struct gl_video_opts),
@@ -701,20 +745,173 @@ static void bind_attrib_locs(GL *gl, GLuint program)
 
 #define PRELUDE_END "// -- prelude end\n"
 
+#define PROGRAM_CACHE_HEADER "mpv shader cache 1.0\n"
+
+static struct bstr load_file(void *talloc_ctx, const char *filename)
+{
+    struct bstr res = {0};
+    stream_t *s = stream_open(filename, NULL);
+    if (s) {
+        res = stream_read_complete(s, talloc_ctx, 1000000000);
+        free_stream(s);
+    }
+    return res;
+}
+
+// 64 bit FNV-1a; only used to derive shader cache file names.
+static uint64_t hash_string(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;
+    return h;
+}
+
+// File format: header, key, '\0', binary format (GLenum), program binary.
+// The key contains the complete source and the driver identification, so
+// hash collisions and driver changes are detected.
+static GLuint load_program_binary(struct gl_video *p, const char *filename,
+                                  const char *key)
+{
+    GL *gl = p->gl;
+
+    if (!mp_path_exists(filename))
+        return 0;
+
+    void *tmp = talloc_new(NULL);
+    struct bstr data = load_file(tmp, filename);
+    GLuint prog = 0;
+    GLenum format;
+    if (bstr_eatstart(&data, bstr0(PROGRAM_CACHE_HEADER))
+        && bstr_eatstart(&data, bstr0(key))
+        && bstr_eatstart(&data, (struct bstr){"", 1})
+        && data.len > sizeof(format))
+    {
+        memcpy(&format, data.start, sizeof(format));
+        data = bstr_cut(data, sizeof(format));
+        prog = gl->CreateProgram();
+        gl->ProgramBinary(prog, format, data.start, data.len);
+        GLint status;
+        gl->GetProgramiv(prog, GL_LINK_STATUS, &status);
+        if (!status) {
+            // Drivers are free to reject binaries, e.g. after an update.
+            MP_VERBOSE(p, "program binary in '%s' rejected.\n", filename);
+            gl->DeleteProgram(prog);
+            prog = 0;
+        }
+    }
+    talloc_free(tmp);
+    return prog;
+}
+
+static void save_program_binary(struct gl_video *p, GLuint prog,
+                                const char *filename, const char *key)
+{
+    GL *gl = p->gl;
+
+    GLint status, size = 0;
+    gl->GetProgramiv(prog, GL_LINK_STATUS, &status);
+    if (status)
+        gl->GetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    void *tmp = talloc_new(NULL);
+    void *data = talloc_size(tmp, size);
+    GLenum format;
+    gl->GetProgramBinary(prog, size, &size, &format, data);
+
+    // Write to a temporary file first, so that concurrent instances never
+    // see partially written files.
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", filename);
+    FILE *out = fopen(tmpname, "wb");
+    bool ok = false;
+    if (out) {
+        fwrite(PROGRAM_CACHE_HEADER, strlen(PROGRAM_CACHE_HEADER), 1, out);
+        fwrite(key, strlen(key) + 1, 1, out);
+        fwrite(&format, sizeof(format), 1, out);
+        fwrite(data, size, 1, out);
+        ok = !ferror(out);
+        ok &= fclose(out) == 0;
+        ok = ok && rename(tmpname, filename) == 0;
+        if (!ok)
+            remove(tmpname);
+    }
+    if (!ok)
+        MP_WARN(p, "Could not write shader cache file '%s'.\n", filename);
+    talloc_free(tmp);
+}
+
+// Return a linked program for the given source. Programs are kept in
+// p->program_cache (and optionally on disk), so reinit_rendering() doesn't
+// recompile shaders that didn't change.
 static GLuint create_program(struct gl_video *p, const char *name,
                              const char *header, const char *vertex,
                              const char *frag)
 {
     GL *gl = p->gl;
-    MP_VERBOSE(p, "compiling shader program '%s', header:\n", name);
-    const char *real_header = strstr(header, PRELUDE_END);
-    real_header = real_header ? real_header + strlen(PRELUDE_END) : header;
-    mp_log_source(p->log, MSGL_V, real_header);
-    GLuint prog = gl->CreateProgram();
-    prog_create_shader(p, prog, GL_VERTEX_SHADER, header, vertex);
-    prog_create_shader(p, prog, GL_FRAGMENT_SHADER, header, frag);
-    bind_attrib_locs(gl, prog);
-    link_shader(p, prog);
+
+    void *tmp = talloc_new(NULL);
+    char *key = talloc_asprintf(tmp, "%zu %zu\n%s%s%s", strlen(header),
+                                strlen(vertex), header, vertex, frag);
+
+    for (int n = 0; n < p->num_program_cache; n++) {
+        struct program_cache_entry e = p->program_cache[n];
+        if (strcmp(e.key, key) == 0) {
+            MP_DBG(p, "reusing shader program '%s'\n", name);
+            MP_TARRAY_REMOVE_AT(p->program_cache, p->num_program_cache, n);
+            MP_TARRAY_APPEND(p, p->program_cache, p->num_program_cache, e);
+            talloc_free(tmp);
+            return e.program;
+        }
+    }
+
+    GLuint prog = 0;
+    char *filename = NULL, *disk_key = NULL;
+    if (p->opts.shader_cache && (gl->mpgl_caps & MPGL_CAP_PROGRAM_BINARY)) {
+        disk_key = talloc_asprintf(tmp, "%s\n%s\n%s\n%s",
+                                   (const char *)gl->GetString(GL_VENDOR),
+                                   (const char *)gl->GetString(GL_RENDERER),
+                                   (const char *)gl->GetString(GL_VERSION),
+                                   key);
+        char *file = talloc_asprintf(tmp, "%016" PRIx64 ".bin",
+                                     hash_string(disk_key));
+        filename = mp_path_join(tmp, bstr0(p->opts.shader_cache), bstr0(file));
+        prog = load_program_binary(p, filename, disk_key);
+        if (prog)
+            MP_VERBOSE(p, "loaded shader program '%s' from '%s'\n",
+                       name, filename);
+    }
+
+    if (!prog) {
+        MP_VERBOSE(p, "compiling shader program '%s', header:\n", name);
+        const char *real_header = strstr(header, PRELUDE_END);
+        real_header = real_header ? real_header + strlen(PRELUDE_END) : header;
+        mp_log_source(p->log, MSGL_V, real_header);
+        prog = gl->CreateProgram();
+        prog_create_shader(p, prog, GL_VERTEX_SHADER, header, vertex);
+        prog_create_shader(p, prog, GL_FRAGMENT_SHADER, header, frag);
+        bind_attrib_locs(gl, prog);
+        if (filename) {
+            gl->ProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                  GL_TRUE);
+        }
+        link_shader(p, prog);
+        if (filename)
+            save_program_binary(p, prog, filename, disk_key);
+    }
+
+    // Programs in use were all touched by the current compile_shaders() call,
+    // so they are never the least recently used entry.
+    if (p->num_program_cache >= PROGRAM_CACHE_SIZE) {
+        gl->DeleteProgram(p->program_cache[0].program);
+        talloc_free(p->program_cache[0].key);
+        MP_TARRAY_REMOVE_AT(p->program_cache, p->num_program_cache, 0);
+    }
+    struct program_cache_entry e = {talloc_steal(p, key), prog};
+    MP_TARRAY_APPEND(p, p->program_cache, p->num_program_cache, e);
+
+    talloc_free(tmp);
     return prog;
 }
 
@@ -912,21 +1109,27 @@ static void compile_shaders(struct gl_video *p)
     talloc_free(tmp);
 }
 
-static void delete_program(GL *gl, GLuint *prog)
+// The programs are owned by p->program_cache, and are deleted only when
+// they're evicted from it, or on gl_video_uninit().
+static void delete_shaders(struct gl_video *p)
 {
-    gl->DeleteProgram(*prog);
-    *prog = 0;
+    for (int n = 0; n < SUBBITMAP_COUNT; n++)
+        p->osd_programs[n] = 0;
+    p->indirect_program = 0;
+    p->scale_sep_program = 0;
+    p->final_program = 0;
 }
 
-static void delete_shaders(struct gl_video *p)
+static void delete_program_cache(struct gl_video *p)
 {
     GL *gl = p->gl;
 
-    for (int n = 0; n < SUBBITMAP_COUNT; n++)
-        delete_program(gl, &p->osd_programs[n]);
-    delete_program(gl, &p->indirect_program);
-    delete_program(gl, &p->scale_sep_program);
-    delete_program(gl, &p->final_program);
+    delete_shaders(p);
+    for (int n = 0; n < p->num_program_cache; n++) {
+        gl->DeleteProgram(p->program_cache[n].program);
+        talloc_free(p->program_cache[n].key);
+    }
+    p->num_program_cache = 0;
 }
 
 static double get_scale_factor(struct gl_video *p)
@@ -948,6 +1151,35 @@ static bool update_scale_factor(struct gl_video *p, struct filter_kernel *kernel
     return mp_init_filter(kernel, filter_sizes, FFMAX(1.0, 1.0 / scale));
 }
 
+// Return the LUT for the kernel, which must have been set up with
+// mp_init_filter(). The result is owned by p->lut_cache.
+static float *get_lut_weights(struct gl_video *p, struct filter_kernel *kernel)
+{
+    for (int n = 0; n < p->num_lut_cache; n++) {
+        struct lut_cache_entry *e = &p->lut_cache[n];
+        // memcmp, because unset params are NAN
+        if (strcmp(e->name, kernel->name) == 0
+            && memcmp(e->params, kernel->params, sizeof(e->params)) == 0
+            && e->size == kernel->size && e->inv_scale == kernel->inv_scale)
+            return e->weights;
+    }
+
+    if (p->num_lut_cache >= LUT_CACHE_SIZE) {
+        talloc_free(p->lut_cache[0].weights);
+        MP_TARRAY_REMOVE_AT(p->lut_cache, p->num_lut_cache, 0);
+    }
+    struct lut_cache_entry e = {
+        .name = kernel->name,
+        .size = kernel->size,
+        .inv_scale = kernel->inv_scale,
+        .weights = talloc_array(p, float, LOOKUP_TEXTURE_SIZE * kernel->size),
+    };
+    memcpy(e.params, kernel->params, sizeof(e.params));
+    mp_compute_lut(kernel, LOOKUP_TEXTURE_SIZE, e.weights);
+    MP_TARRAY_APPEND(p, p->lut_cache, p->num_lut_cache, e);
+    return e.weights;
+}
+
 static void init_scaler(struct gl_video *p, struct scaler *scaler)
 {
     GL *gl = p->gl;
@@ -989,8 +1221,7 @@ static void init_scaler(struct gl_video *p, struct scaler *scaler)
     gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
     gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
-    float *weights = talloc_array(NULL, float, LOOKUP_TEXTURE_SIZE * size);
-    mp_compute_lut(scaler->kernel, LOOKUP_TEXTURE_SIZE, weights);
+    float *weights = get_lut_weights(p, scaler->kernel);
     if (use_2d) {
         gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format, fmt->pixels,
                        LOOKUP_TEXTURE_SIZE, 0, fmt->format, GL_FLOAT,
@@ -1000,7 +1231,6 @@ static void init_scaler(struct gl_video *p, struct scaler *scaler)
                        LOOKUP_TEXTURE_SIZE, 0, fmt->format, GL_FLOAT,
                        weights);
     }
-    talloc_free(weights);
 
     gl->TexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     gl->TexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -1264,11 +1494,20 @@ static void uninit_video(struct gl_video *p)
 
         gl->DeleteTextures(1, &plane->gl_texture);
         plane->gl_texture = 0;
-        gl->DeleteBuffers(1, &plane->gl_buffer);
-        plane->gl_buffer = 0;
+        gl->DeleteBuffers(NUM_PBOS, plane->gl_buffers);
+        for (int i = 0; i < NUM_PBOS; i++) {
+            plane->gl_buffers[i] = 0;
+            plane->buffer_sizes[i] = 0;
+        }
         plane->buffer_ptr = NULL;
-        plane->buffer_size = 0;
     }
+    for (int i = 0; i < NUM_PBOS; i++) {
+        if (vimg->pbo_fences[i])
+            gl->DeleteSync(vimg->pbo_fences[i]);
+        vimg->pbo_fences[i] = NULL;
+    }
+    vimg->pbo_index = 0;
+    vimg->slice_image = NULL;
 
     fbotex_uninit(p, &p->indirect_fbo);
     fbotex_uninit(p, &p->scale_sep_fbo);
@@ -1492,6 +1731,31 @@ void gl_video_resize(struct gl_video *p, struct mp_rect *window,
     check_resize(p);
 }
 
+// Wait until the GPU doesn't read from the PBOs at index anymore. Returns
+// false if this is unknown, in which case mapping must be synchronized.
+static bool wait_pbo_fence(struct gl_video *p, int index)
+{
+    GL *gl = p->gl;
+    struct video_image *vimg = &p->image;
+
+    if (!(gl->mpgl_caps & MPGL_CAP_SYNC))
+        return false;
+
+    GLsync fence = vimg->pbo_fences[index];
+    if (!fence)
+        return true;
+    vimg->pbo_fences[index] = NULL;
+
+    GLenum res = gl->ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    PBO_FENCE_TIMEOUT);
+    gl->DeleteSync(fence);
+    if (res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED) {
+        MP_WARN(p, "Waiting for video PBO fence failed.\n");
+        return false;
+    }
+    return true;
+}
+
 static bool get_image(struct gl_video *p, struct mp_image *mpi)
 {
     GL *gl = p->gl;
@@ -1500,32 +1764,107 @@ static bool get_image(struct gl_video *p, struct mp_image *mpi)
         return false;
 
     struct video_image *vimg = &p->image;
+    int index = vimg->pbo_index;
 
     // See comments in init_video() about odd video sizes.
     // The normal upload path does this too, but less explicit.
     mp_image_set_size(mpi, vimg->planes[0].w, vimg->planes[0].h);
 
+    // The buffers can be mapped already if slices were uploaded.
+    bool unsynchronized = false;
+    if (!vimg->planes[0].buffer_ptr && (gl->mpgl_caps & MPGL_CAP_MAP_RANGE))
+        unsynchronized = wait_pbo_fence(p, index);
+
     for (int n = 0; n < p->plane_count; n++) {
         struct texplane *plane = &vimg->planes[n];
         mpi->stride[n] = mpi->plane_w[n] * p->image_desc.bytes[n];
         int needed_size = mpi->plane_h[n] * mpi->stride[n];
-        if (!plane->gl_buffer)
-            gl->GenBuffers(1, &plane->gl_buffer);
-        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, plane->gl_buffer);
-        if (needed_size > plane->buffer_size) {
-            plane->buffer_size = needed_size;
-            gl->BufferData(GL_PIXEL_UNPACK_BUFFER, plane->buffer_size,
-                           NULL, GL_DYNAMIC_DRAW);
+        if (!plane->gl_buffers[index])
+            gl->GenBuffers(1, &plane->gl_buffers[index]);
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, plane->gl_buffers[index]);
+        if (!plane->buffer_ptr) {
+            if (needed_size > plane->buffer_sizes[index]) {
+                plane->buffer_sizes[index] = needed_size;
+                gl->BufferData(GL_PIXEL_UNPACK_BUFFER, needed_size, NULL,
+                               GL_STREAM_DRAW);
+            }
+            if (unsynchronized) {
+                // The fence guarantees that the GPU is done with the buffer.
+                plane->buffer_ptr =
+                    gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, needed_size,
+                                       GL_MAP_WRITE_BIT |
+                                       GL_MAP_UNSYNCHRONIZED_BIT);
+            } else {
+                // Orphan the old storage, so that the driver can hand out
+                // new memory instead of waiting for the GPU.
+                gl->BufferData(GL_PIXEL_UNPACK_BUFFER,
+                               plane->buffer_sizes[index], NULL,
+                               GL_STREAM_DRAW);
+                plane->buffer_ptr = gl->MapBuffer(GL_PIXEL_UNPACK_BUFFER,
+                                                  GL_WRITE_ONLY);
+            }
         }
-        if (!plane->buffer_ptr)
-            plane->buffer_ptr = gl->MapBuffer(GL_PIXEL_UNPACK_BUFFER,
-                                              GL_WRITE_ONLY);
         mpi->planes[n] = plane->buffer_ptr;
         gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     }
     return true;
 }
 
+// Copy the image rows y0 to y1 from src to the mapped PBOs in dst.
+static void copy_rows(struct gl_video *p, struct mp_image *dst,
+                      struct mp_image *src, int y0, int y1)
+{
+    for (int n = 0; n < p->plane_count; n++) {
+        int ys = p->image_desc.ys[n];
+        int r0 = y0 >> ys;
+        int r1 = MPMIN((y1 + (1 << ys) - 1) >> ys, src->plane_h[n]);
+        if (r1 <= r0)
+            continue;
+        int line_bytes = src->plane_w[n] * p->image_desc.bytes[n];
+        // Mapped buffers are often uncached or write-combined memory.
+        memcpy_pic_stream(dst->planes[n] + r0 * dst->stride[n],
+                          src->planes[n] + r0 * src->stride[n],
+                          line_bytes, r1 - r0, dst->stride[n], src->stride[n]);
+    }
+}
+
+// Copy the rows y0 to y1 of the image that will be passed to the next
+// gl_video_upload_image() call into the PBOs, so that only the remaining rows
+// have to be copied then. Works only if PBOs are enabled. mpi == NULL drops
+// the slices received so far.
+bool gl_video_upload_slice(struct gl_video *p, struct mp_image *mpi,
+                           int y0, int y1)
+{
+    struct video_image *vimg = &p->image;
+
+    if (!mpi || !p->opts.pbo || mpi->imgfmt != p->image_format ||
+        mpi->w != p->image_params.w || mpi->h != p->image_params.h ||
+        mpi->stride[0] < 0)
+    {
+        vimg->slice_image = NULL;
+        return false;
+    }
+
+    if (y0 == 0) {
+        vimg->slice_image = mpi->planes[0];
+        vimg->slice_rows = 0;
+    }
+
+    if (vimg->slice_image != mpi->planes[0] || y0 != vimg->slice_rows) {
+        vimg->slice_image = NULL;
+        return false;
+    }
+
+    mp_image_t mpi2 = *mpi;
+    if (!get_image(p, &mpi2)) {
+        vimg->slice_image = NULL;
+        return false;
+    }
+    copy_rows(p, &mpi2, mpi, y0, y1);
+    vimg->slice_rows = y1;
+    return true;
+}
+
 void gl_video_upload_image(struct gl_video *p, struct mp_image *mpi)
 {
     GL *gl = p->gl;
@@ -1535,14 +1874,15 @@ void gl_video_upload_image(struct gl_video *p, struct mp_image *mpi)
 
     struct video_image *vimg = &p->image;
 
+    int skip_rows = 0;
+    if (vimg->slice_image == mpi->planes[0] && mpi->stride[0] >= 0)
+        skip_rows = vimg->slice_rows;
+    vimg->slice_image = NULL;
+
     mp_image_t mpi2 = *mpi;
     bool pbo = false;
-    if (!vimg->planes[0].buffer_ptr && get_image(p, &mpi2)) {
-        for (n = 0; n < p->plane_count; n++) {
-            int line_bytes = mpi->plane_w[n] * p->image_desc.bytes[n];
-            memcpy_pic(mpi2.planes[n], mpi->planes[n], line_bytes, mpi->plane_h[n],
-                       mpi2.stride[n], mpi->stride[n]);
-        }
+    if (get_image(p, &mpi2)) {
+        copy_rows(p, &mpi2, mpi, skip_rows, mpi->h);
         mpi = &mpi2;
         pbo = true;
     }
@@ -1551,7 +1891,8 @@ void gl_video_upload_image(struct gl_video *p, struct mp_image *mpi)
         struct texplane *plane = &vimg->planes[n];
         void *plane_ptr = mpi->planes[n];
         if (pbo) {
-            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, plane->gl_buffer);
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER,
+                           plane->gl_buffers[vimg->pbo_index]);
             if (!gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
                 MP_FATAL(p, "Video PBO upload failed. "
                          "Remove the 'pbo' suboption.\n");
@@ -1565,6 +1906,19 @@ void gl_video_upload_image(struct gl_video *p, struct mp_image *mpi)
     }
     gl->ActiveTexture(GL_TEXTURE0);
     gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (pbo) {
+        // The texture uploads above are the last users of these PBOs.
+        // get_image() doesn't wait on the previous fence if the buffers
+        // were mapped without it, so it may still be set.
+        if (gl->mpgl_caps & MPGL_CAP_SYNC) {
+            GLsync *fence = &vimg->pbo_fences[vimg->pbo_index];
+            if (*fence)
+                gl->DeleteSync(*fence);
+            *fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        vimg->pbo_index = (vimg->pbo_index + 1) % NUM_PBOS;
+    }
 }
 
 struct mp_image *gl_video_download_image(struct gl_video *p)
@@ -1827,6 +2181,8 @@ void gl_video_uninit(struct gl_video *p)
 
     uninit_video(p);
 
+    delete_program_cache(p);
+
     if (gl->DeleteVertexArrays)
         gl->DeleteVertexArrays(1, &p->vao);
     gl->DeleteBuffers(1, &p->vertex_buffer);
@@ -46,6 +46,7 @@ struct gl_video_opts {
     int stereo_mode;
     int enable_alpha;
     int chroma_location;
+    char *shader_cache;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -60,6 +61,8 @@ void gl_video_set_output_depth(struct gl_video *p, int r, int g, int b);
 void gl_video_set_lut3d(struct gl_video *p, struct lut3d *lut3d);
 void gl_video_draw_osd(struct gl_video *p, struct osd_state *osd);
 void gl_video_upload_image(struct gl_video *p, struct mp_image *img);
+bool gl_video_upload_slice(struct gl_video *p, struct mp_image *mpi,
+                           int y0, int y1);
 void gl_video_render_frame(struct gl_video *p);
 struct mp_image *gl_video_download_image(struct gl_video *p);
 void gl_video_resize(struct gl_video *p, struct mp_rect *window,
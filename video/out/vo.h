@@ -77,6 +77,8 @@ enum mp_voctrl {
 
     VOCTRL_SCREENSHOT,                  // struct voctrl_screenshot_args*
 
+    VOCTRL_DRAW_SLICE,                  // struct voctrl_draw_slice_args*
+
     VOCTRL_SET_COMMAND_LINE,            // char**
 };
 
@@ -92,6 +94,17 @@ struct voctrl_get_equalizer_args {
     int *valueptr;
 };
 
+// VOCTRL_DRAW_SLICE
+// Rows y0 to y1 of the next frame passed to draw_image() have been decoded,
+// and can be converted or uploaded in advance. img always refers to the whole
+// frame, but only the rows from 0 to y1 contain valid data. Slices come in top
+// to bottom order; y0 == 0 starts a new frame. img == NULL means the VO must
+// forget about slices it has seen so far.
+struct voctrl_draw_slice_args {
+    struct mp_image *img;
+    int y0, y1;
+};
+
 // VOCTRL_SCREENSHOT
 struct voctrl_screenshot_args {
     // 0: Save image of the currently displayed video frame, in original
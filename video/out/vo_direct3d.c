@@ -1402,7 +1402,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     if (!get_video_buffer(priv, &buffer))
         return;
 
-    mp_image_copy(&buffer, mpi);
+    mp_image_copy_stream(&buffer, mpi);
 
     d3d_unlock_video_objects(priv);
 
@@ -20,13 +20,22 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include <libswscale/swscale.h>
 
 #include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "mpvcore/bstr.h"
 #include "osdep/io.h"
+#include "osdep/numcores.h"
 #include "mpvcore/path.h"
 #include "talloc.h"
 #include "mpvcore/mp_msg.h"
@@ -39,15 +48,54 @@
 #include "video/sws_utils.h"
 #include "sub/sub.h"
 #include "mpvcore/m_option.h"
+#include "mpvcore/mp_common.h"
+#include "mpvcore/mp_thread_pool.h"
+
+struct write_job {
+    struct priv *p;
+    struct mp_image *image;
+    char *filename;
+    // Set by the writer thread; access only with priv.lock held.
+    bool done, ok;
+};
 
 struct priv {
     struct image_writer_opts *opts;
     char *outdir;
+    int outfd;
+    int threads;
+    int queue;
 
     struct mp_image *current;
     int frame;
+
+    FILE *outfp;
+
+    // Writer threads (file output only), created on first use.
+    struct mp_thread_pool *pool;
+    int max_jobs;
+    // Queued images, in frame order. Accessed by the VO thread only.
+    struct write_job **jobs;
+    int num_jobs;
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // signaled when a job finishes
+#endif
 };
 
+#if HAVE_PTHREADS
+#define LOCK(p) pthread_mutex_lock(&(p)->lock)
+#define UNLOCK(p) pthread_mutex_unlock(&(p)->lock)
+#define WAIT(p) pthread_cond_wait(&(p)->wakeup, &(p)->lock)
+#define SIGNAL(p) pthread_cond_broadcast(&(p)->wakeup)
+#else
+// Jobs are run synchronously, so nothing is ever waited for.
+#define LOCK(p) do {} while (0)
+#define UNLOCK(p) do {} while (0)
+#define WAIT(p) abort()
+#define SIGNAL(p) do {} while (0)
+#endif
+
 static bool checked_mkdir(struct vo *vo, const char *buf)
 {
     MP_INFO(vo, "Creating output directory '%s'...\n", buf);
@@ -69,7 +117,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
     struct priv *p = vo->priv;
     mp_image_unrefp(&p->current);
 
-    if (p->outdir && vo->config_count < 1)
+    if (p->outdir && p->outfd < 0 && vo->config_count < 1)
         if (!checked_mkdir(vo, p->outdir))
             return -1;
 
@@ -101,24 +149,102 @@ static void draw_osd(struct vo *vo, struct osd_state *osd)
     osd_draw_on_image(osd, dim, osd->vo_pts, OSD_DRAW_SUB_ONLY, p->current);
 }
 
+static void write_job(void *ptr)
+{
+    struct write_job *job = ptr;
+    struct priv *p = job->p;
+
+    bool ok = write_image(job->image, p->opts, job->filename);
+
+    LOCK(p);
+    job->ok = ok;
+    job->done = true;
+    SIGNAL(p);
+    UNLOCK(p);
+}
+
+// Free finished jobs. If wait is set, block until at least one job is done.
+static void reap_jobs(struct vo *vo, bool wait)
+{
+    struct priv *p = vo->priv;
+
+    LOCK(p);
+    while (1) {
+        bool any_done = false;
+        for (int n = 0; n < p->num_jobs; n++) {
+            struct write_job *job = p->jobs[n];
+            if (!job->done)
+                continue;
+            if (!job->ok)
+                MP_ERR(vo, "Error writing %s\n", job->filename);
+            talloc_free(job);
+            MP_TARRAY_REMOVE_AT(p->jobs, p->num_jobs, n);
+            n--;
+            any_done = true;
+        }
+        if (any_done || !wait || !p->num_jobs)
+            break;
+        WAIT(p);
+    }
+    UNLOCK(p);
+}
+
+static void write_to_fd(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    // The frames have to be concatenated in order, so they're encoded right
+    // here, directly into the stream.
+    if (!write_image_fp(p->current, p->opts, p->outfp) || fflush(p->outfp))
+        MP_ERR(vo, "Error writing frame %d to fd %d\n", p->frame, p->outfd);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    if (!p->current)
+        return;
+
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
-                                     image_writer_file_ext(p->opts));
+    if (p->outfd >= 0) {
+        write_to_fd(vo);
+        mp_image_unrefp(&p->current);
+        return;
+    }
 
-    if (p->outdir && strlen(p->outdir))
-        filename = mp_path_join(t, bstr0(p->outdir), bstr0(filename));
+    if (!p->pool) {
+        int threads = p->threads ? p->threads : default_thread_count();
+        threads = MPMAX(threads, 1);
+        p->pool = mp_thread_pool_create(p, threads);
+        p->max_jobs = p->queue ? p->queue : threads * 2;
+    }
 
-    MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts, filename);
+    reap_jobs(vo, false);
+    // Block decoding if the writer threads can't keep up.
+    while (p->num_jobs >= p->max_jobs)
+        reap_jobs(vo, true);
 
-    talloc_free(t);
-    mp_image_unrefp(&p->current);
+    // Filenames are assigned here, so they're in frame order, regardless of
+    // the order in which the writer threads finish.
+    struct write_job *job = talloc_ptrtype(p, job);
+    *job = (struct write_job) {
+        .p = p,
+        .image = talloc_steal(job, p->current),
+        .filename = talloc_asprintf(job, "%08d.%s", p->frame,
+                                    image_writer_file_ext(p->opts)),
+    };
+    p->current = NULL;
+
+    if (p->outdir && strlen(p->outdir)) {
+        job->filename = mp_path_join(job, bstr0(p->outdir),
+                                     bstr0(job->filename));
+    }
+
+    MP_INFO(vo, "Saving %s\n", job->filename);
+    MP_TARRAY_APPEND(p, p->jobs, p->num_jobs, job);
+    mp_thread_pool_queue(p->pool, write_job, job);
 }
 
 static int query_format(struct vo *vo, uint32_t fmt)
@@ -132,12 +258,46 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    if (p->pool) {
+        mp_thread_pool_wait(p->pool);
+        reap_jobs(vo, false);
+        talloc_free(p->pool);
+    }
+    if (p->outfp)
+        fclose(p->outfp);
     mp_image_unrefp(&p->current);
+#if HAVE_PTHREADS
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+#endif
 }
 
 static int preinit(struct vo *vo)
 {
+    struct priv *p = vo->priv;
+
     vo->untimed = true;
+#if HAVE_PTHREADS
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+#endif
+
+    if (p->outfd >= 0) {
+        // Write out text printed before --vo=image:outfd=1 took over stdout
+        // (see mp_msg_stdout_in_use), instead of mixing it into the images.
+        fflush(stdout);
+        // The fd belongs to the caller, so don't close it on uninit.
+        int fd = dup(p->outfd);
+        if (fd >= 0)
+            p->outfp = fdopen(fd, "wb");
+        if (!p->outfp) {
+            MP_FATAL(vo, "Can't open fd %d: %s\n", p->outfd, strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            uninit(vo);
+            return -1;
+        }
+    }
     return 0;
 }
 
@@ -165,6 +325,9 @@ const struct vo_driver video_out_image =
     .options = (const struct m_option[]) {
         OPT_SUBSTRUCT("", opts, image_writer_conf, 0),
         OPT_STRING("outdir", outdir, 0),
+        OPT_INT("outfd", outfd, 0, OPTDEF_INT(-1)),
+        OPT_INTRANGE("threads", threads, 0, 0, 64),
+        OPT_INTRANGE("queue", queue, 0, 0, 1000),
         {0},
     },
     .preinit = preinit,
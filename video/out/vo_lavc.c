@@ -36,6 +36,9 @@
 #include "sub/sub.h"
 #include "sub/dec_sub.h"
 
+// Number of frames that can be queued for the encoder thread.
+#define ENCODE_QUEUE_SIZE 4
+
 struct priv {
     uint8_t *buffer;
     size_t buffer_size;
@@ -58,6 +61,16 @@ struct priv {
     int worst_time_base_is_stream;
 
     struct mp_csp_details colorspace;
+
+    // runs encode_job(); NULL if encoding is synchronous
+    struct encode_lavc_worker *worker;
+};
+
+struct encode_job {
+    struct vo *vo;
+    AVFrame *frame;             // NULL: flush the encoder
+    struct mp_image *image;     // reference to the frame's image data
+    int64_t lastipts;
 };
 
 static int preinit(struct vo *vo)
@@ -86,6 +99,10 @@ static void uninit(struct vo *vo)
     if (vc->lastipts >= 0 && vc->stream)
         draw_image(vo, NULL);
 
+    encode_lavc_worker_wait(vc->worker);
+    talloc_free(vc->worker);
+    vc->worker = NULL;
+
     mp_image_unrefp(&vc->lastimg);
 
     vo->priv = NULL;
@@ -167,6 +184,9 @@ static int config(struct vo *vo, uint32_t width, uint32_t height,
 
     vc->buffer = talloc_size(vc, vc->buffer_size);
 
+    vc->worker = encode_lavc_worker_create(vo->encode_lavc_ctx, vc,
+                                           ENCODE_QUEUE_SIZE);
+
     mp_image_unrefp(&vc->lastimg);
 
     return 0;
@@ -193,7 +213,8 @@ static int query_format(struct vo *vo, uint32_t format)
             // we don't convert colorspaces here
 }
 
-static void write_packet(struct vo *vo, int size, AVPacket *packet)
+static void write_packet(struct vo *vo, int size, AVPacket *packet,
+                         int64_t lastipts)
 {
     struct priv *vc = vo->priv;
 
@@ -210,7 +231,7 @@ static void write_packet(struct vo *vo, int size, AVPacket *packet)
                                        vc->stream->time_base);
         } else {
             mp_msg(MSGT_ENCODE, MSGL_V, "vo-lavc: codec did not provide pts\n");
-            packet->pts = av_rescale_q(vc->lastipts, vc->worst_time_base,
+            packet->pts = av_rescale_q(lastipts, vc->worst_time_base,
                                        vc->stream->time_base);
         }
         if (packet->dts != AV_NOPTS_VALUE) {
@@ -273,11 +294,47 @@ static int encode_video(struct vo *vo, AVFrame *frame, AVPacket *packet)
     }
 }
 
+// Runs on the encoder thread if there is a worker. vc->buffer and the
+// codec context are only accessed from here after the codec was opened.
+static void encode_job(void *ptr)
+{
+    struct encode_job *job = ptr;
+    struct vo *vo = job->vo;
+    struct priv *vc = vo->priv;
+    AVPacket packet;
+    int size;
+
+    do {
+        av_init_packet(&packet);
+        packet.data = vc->buffer;
+        packet.size = vc->buffer_size;
+        size = encode_video(vo, job->frame, &packet);
+        write_packet(vo, size, &packet, job->lastipts);
+    } while (!job->frame && size > 0);
+
+    if (job->frame)
+        avcodec_free_frame(&job->frame);
+    mp_image_unrefp(&job->image);
+    talloc_free(job);
+}
+
+static void queue_encode(struct vo *vo, AVFrame *frame, int64_t lastipts)
+{
+    struct priv *vc = vo->priv;
+    struct encode_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct encode_job) {
+        .vo = vo,
+        .frame = frame,
+        .image = frame ? mp_image_new_ref(vc->lastimg) : NULL,
+        .lastipts = lastipts,
+    };
+    encode_lavc_worker_queue(vc->worker, encode_job, job);
+}
+
 static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *vc = vo->priv;
     struct encode_lavc_context *ectx = vo->encode_lavc_ctx;
-    int size;
     AVFrame *frame;
     AVCodecContext *avc;
     int64_t frameipts;
@@ -406,12 +463,9 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     }
 
     if (vc->lastipts != MP_NOPTS_VALUE) {
-        frame = avcodec_alloc_frame();
-
         // we have a valid image in lastimg
         while (vc->lastipts < frameipts) {
             int64_t thisduration = vc->harddup ? 1 : (frameipts - vc->lastipts);
-            AVPacket packet;
 
             // we will ONLY encode this frame if it can be encoded at at least
             // vc->mindeltapts after the last encoded frame!
@@ -421,7 +475,8 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
                 skipframes = 0;
 
             if (thisduration > skipframes) {
-                avcodec_get_frame_defaults(frame);
+                // freed by the encoder job
+                frame = avcodec_alloc_frame();
 
                 // this is a nop, unless the worst time base is the STREAM time base
                 frame->pts = av_rescale_q(vc->lastipts + skipframes,
@@ -434,31 +489,18 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 
                 frame->quality = avc->global_quality;
 
-                av_init_packet(&packet);
-                packet.data = vc->buffer;
-                packet.size = vc->buffer_size;
-                size = encode_video(vo, frame, &packet);
-                write_packet(vo, size, &packet);
+                queue_encode(vo, frame, vc->lastipts);
                 ++vc->lastdisplaycount;
                 vc->lastencodedipts = vc->lastipts + skipframes;
             }
 
             vc->lastipts += thisduration;
         }
-
-        avcodec_free_frame(&frame);
     }
 
     if (!mpi) {
         // finish encoding
-        do {
-            AVPacket packet;
-            av_init_packet(&packet);
-            packet.data = vc->buffer;
-            packet.size = vc->buffer_size;
-            size = encode_video(vo, NULL, &packet);
-            write_packet(vo, size, &packet);
-        } while (size > 0);
+        queue_encode(vo, NULL, vc->lastipts);
     } else {
         if (frameipts >= vc->lastframeipts) {
             if (vc->lastframeipts != MP_NOPTS_VALUE && vc->lastdisplaycount != 1)
@@ -265,6 +265,23 @@ static int control(struct vo *vo, uint32_t request, void *data)
         gl_video_render_frame(p->renderer);
         mpgl_unlock(p->glctx);
         return true;
+    case VOCTRL_DRAW_SLICE: {
+        struct voctrl_draw_slice_args *args = data;
+        // draw_image() flips the image, so the rows wouldn't match.
+        if (p->vo_flipped)
+            return VO_NOTIMPL;
+        mpgl_lock(p->glctx);
+        bool r = gl_video_upload_slice(p->renderer, args->img,
+                                       args->y0, args->y1);
+        mpgl_unlock(p->glctx);
+        return r ? VO_TRUE : VO_FALSE;
+    }
+    case VOCTRL_RESET:
+    case VOCTRL_SKIPFRAME:
+        mpgl_lock(p->glctx);
+        gl_video_upload_slice(p->renderer, NULL, 0, 0);
+        mpgl_unlock(p->glctx);
+        break;
     case VOCTRL_SET_COMMAND_LINE: {
         char *arg = data;
         return reparse_cmdline(p, arg);
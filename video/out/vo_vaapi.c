@@ -549,7 +549,7 @@ static int upload_surface(struct priv *p, struct vaapi_surface *va_surface,
     struct mp_image img;
     if (map_image(p, &va_surface->image, mpi->imgfmt, &img) < 0)
         return -1;
-    mp_image_copy(&img, mpi);
+    mp_image_copy_stream(&img, mpi);
     unmap_image(p, &va_surface->image);
 
     if (!va_surface->is_bound) {
@@ -978,7 +978,7 @@ static void generate_osd_part(struct vo *vo, struct sub_bitmaps *imgs)
     if (!sfc->packer)
         sfc->packer = make_packer(vo, format);
     sfc->packer->padding = imgs->scaled; // assume 2x2 filter on scaling
-    int r = packer_pack_from_subbitmaps(sfc->packer, imgs);
+    int r = packer_update_from_subbitmaps(sfc->packer, imgs);
     if (r < 0) {
         MP_ERR(vo, "OSD bitmaps do not fit on a surface with the maximum "
                "supported size\n");
@@ -997,7 +997,10 @@ static void generate_osd_part(struct vo *vo, struct sub_bitmaps *imgs)
             sfc->surface = VDP_INVALID_HANDLE;
         CHECK_ST_WARNING("OSD: error when creating surface");
     }
-    if (imgs->scaled) {
+    bool all = true;
+    for (int i = 0; i < sfc->packer->count; i++)
+        all &= sfc->packer->fresh[i];
+    if (imgs->scaled && all) {
         char zeros[sfc->packer->used_width * format_size];
         memset(zeros, 0, sizeof(zeros));
         vdp_st = vdp->bitmap_surface_put_bits_native(sfc->surface,
@@ -1031,7 +1034,19 @@ osd_skip_upload:
             target->color.green = ((color >> 16) & 0xff) / 255.0;
             target->color.red   = ((color >> 24) & 0xff) / 255.0;
         }
-        if (need_upload) {
+        // Bitmaps that kept their position are still on the surface.
+        if (need_upload && sfc->packer->fresh[i]) {
+            if (imgs->scaled && !all) {
+                // Clear the padding
+                int pad = sfc->packer->padding;
+                int w = FFMIN(b->w + pad, sfc->packer->w - x);
+                int h = FFMIN(b->h + pad, sfc->packer->h - y);
+                char zeros[w * format_size];
+                memset(zeros, 0, sizeof(zeros));
+                vdp_st = vdp->bitmap_surface_put_bits_native(sfc->surface,
+                        &(const void *){zeros}, &(uint32_t){0},
+                        &(VdpRect){x, y, x + w, y + h});
+            }
             vdp_st = vdp->
                 bitmap_surface_put_bits_native(sfc->surface,
                                                &(const void *){b->bitmap},
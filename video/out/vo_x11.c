@@ -90,6 +90,11 @@ struct priv {
     int current_buf;
     int num_buffers;
 
+    // Frame whose first slice_rows rows were already converted into
+    // the current buffer by draw_slice() (identified by its first plane)
+    void *slice_image;
+    int slice_rows;
+
     int Shmem_Flag;
 #ifdef HAVE_SHM
     int Shm_Warned_Slow;
@@ -389,6 +394,7 @@ static bool resize(struct vo *vo)
 
     vo_x11_clear_background(vo, &p->dst);
 
+    p->slice_image = NULL;
     vo->want_redraw = true;
     return true;
 }
@@ -472,20 +478,76 @@ static void flip_page(struct vo *vo)
         XSync(vo->x11->display, False);
 }
 
-static void draw_image(struct vo *vo, mp_image_t *mpi)
+static struct mp_image get_cropped_source(struct priv *p, struct mp_image *mpi)
 {
-    struct priv *p = vo->priv;
-
-    wait_for_completion(vo, p->num_buffers - 1);
-
     struct mp_image src = *mpi;
     struct mp_rect src_rc = p->src;
     src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, src.fmt.align_x);
     src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, src.fmt.align_y);
     mp_image_crop_rc(&src, src_rc);
+    return src;
+}
+
+static bool draw_slice(struct vo *vo, struct mp_image *mpi, int y0, int y1)
+{
+    struct priv *p = vo->priv;
+
+    // The kernel scaler (--sws-kernel) can't scale slices.
+    if (!mpi || !p->sws->sws || p->sws->kscale) {
+        p->slice_image = NULL;
+        return false;
+    }
+
+    struct mp_image src = get_cropped_source(p, mpi);
+    if (src.imgfmt != p->sws->src.imgfmt)
+        return false;
+
+    // Make the slice relative to the cropped source image.
+    int crop_y = MP_ALIGN_DOWN(p->src.y0, mpi->fmt.align_y);
+    y0 = av_clip(y0 - crop_y, 0, src.h);
+    y1 = av_clip(y1 - crop_y, 0, src.h);
+
+    if (y0 == 0) {
+        // The buffer might still be in use by the X server.
+        wait_for_completion(vo, p->num_buffers - 1);
+        p->slice_image = mpi->planes[0];
+        p->slice_rows = 0;
+    }
 
+    // swscale can handle slices only in order, and starting at chroma lines.
+    if (p->slice_image != mpi->planes[0] || y0 != p->slice_rows ||
+        (y0 & (src.fmt.align_y - 1)))
+    {
+        p->slice_image = NULL;
+        return false;
+    }
+
+    if (y1 > y0) {
+        struct mp_image img = get_x_buffer(p, p->current_buf);
+        mp_sws_scale_slice(p->sws, &img, &src, y0, y1 - y0);
+        p->slice_rows = y1;
+    }
+    return true;
+}
+
+static void draw_image(struct vo *vo, mp_image_t *mpi)
+{
+    struct priv *p = vo->priv;
+
+    struct mp_image src = get_cropped_source(p, mpi);
     struct mp_image img = get_x_buffer(p, p->current_buf);
-    mp_sws_scale(p->sws, &img, &src);
+
+    if (p->slice_image == mpi->planes[0] && p->slice_rows > 0) {
+        // Only the rows which weren't sent as slices are left.
+        if (p->slice_rows < src.h) {
+            mp_sws_scale_slice(p->sws, &img, &src, p->slice_rows,
+                               src.h - p->slice_rows);
+        }
+    } else {
+        wait_for_completion(vo, p->num_buffers - 1);
+        mp_sws_scale(p->sws, &img, &src);
+    }
+    p->slice_image = NULL;
 
     mp_image_setrefp(&p->original_image, mpi);
 }
@@ -626,6 +688,14 @@ static int control(struct vo *vo, uint32_t request, void *data)
         return VO_TRUE;
     case VOCTRL_REDRAW_FRAME:
         return redraw_frame(vo);
+    case VOCTRL_DRAW_SLICE: {
+        struct voctrl_draw_slice_args *args = data;
+        return draw_slice(vo, args->img, args->y0, args->y1) ? VO_TRUE : VO_FALSE;
+    }
+    case VOCTRL_RESET:
+    case VOCTRL_SKIPFRAME:
+        p->slice_image = NULL;
+        break;
     case VOCTRL_WINDOW_TO_OSD_COORDS: {
         // OSD is rendered into the scaled image
         float *c = data;
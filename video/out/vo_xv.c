@@ -660,7 +660,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     wait_for_completion(vo, ctx->num_buffers - 1);
 
     struct mp_image xv_buffer = get_xv_buffer(vo, ctx->current_buf);
-    mp_image_copy(&xv_buffer, mpi);
+    mp_image_copy_stream(&xv_buffer, mpi);
 
     mp_image_setrefp(&ctx->original_image, mpi);
 }
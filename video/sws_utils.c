@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -24,7 +25,9 @@
 
 #include "sws_utils.h"
 
+#include "talloc.h"
 #include "video/mp_image.h"
+#include "video/kernel_scale.h"
 #include "video/img_format.h"
 #include "fmt-conversion.h"
 #include "csputils.h"
@@ -32,6 +35,7 @@
 
 //global sws_flags from the command line
 int sws_flags = 2;
+char *sws_kernel;
 
 float sws_lum_gblur = 0.0;
 float sws_chr_gblur = 0.0;
@@ -58,6 +62,7 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx)
     ctx->force_reload = true;
 
     ctx->flags = SWS_PRINT_INFO;
+    ctx->kernel = sws_kernel;
 
     switch (sws_flags) {
     case 0:  ctx->flags |= SWS_FAST_BILINEAR;   break;
@@ -141,6 +146,9 @@ static bool cache_valid(struct mp_sws_context *ctx)
     struct mp_sws_context *old = ctx->cached;
     if (ctx->force_reload)
         return false;
+    if (!ctx->kernel != !old->kernel ||
+        (ctx->kernel && strcmp(ctx->kernel, old->kernel) != 0))
+        return false;
     return mp_image_params_equals(&ctx->src, &old->src) &&
            mp_image_params_equals(&ctx->dst, &old->dst) &&
            ctx->flags == old->flags &&
@@ -155,6 +163,7 @@ static int free_mp_sws(void *p)
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
+    talloc_free(ctx->kscale_tmp);
     return 0;
 }
 
@@ -190,6 +199,21 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (cache_valid(ctx))
         return 0;
 
+    talloc_free(ctx->kscale);
+    ctx->kscale = NULL;
+    if (ctx->kernel && (src->w != dst->w || src->h != dst->h) &&
+        mp_kscale_supported_format(src->imgfmt))
+    {
+        ctx->kscale = mp_kscale_alloc(ctx, ctx->kernel);
+        if (!ctx->kscale) {
+            mp_msg(MSGT_VFILTER, MSGL_WARN, "Unknown scaler kernel '%s', "
+                   "using libswscale.\n", ctx->kernel);
+        }
+    }
+    // With the kernel scaler, libswscale only converts the scaled image.
+    int sws_src_w = ctx->kscale ? dst->w : src->w;
+    int sws_src_h = ctx->kscale ? dst->h : src->h;
+
     sws_freeContext(ctx->sws);
     ctx->sws = sws_alloc_context();
     if (!ctx->sws)
@@ -225,8 +249,8 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
 
     av_opt_set_int(ctx->sws, "sws_flags", ctx->flags, 0);
 
-    av_opt_set_int(ctx->sws, "srcw", src->w, 0);
-    av_opt_set_int(ctx->sws, "srch", src->h, 0);
+    av_opt_set_int(ctx->sws, "srcw", sws_src_w, 0);
+    av_opt_set_int(ctx->sws, "srch", sws_src_h, 0);
     av_opt_set_int(ctx->sws, "src_format", s_fmt, 0);
 
     av_opt_set_int(ctx->sws, "dstw", dst->w, 0);
@@ -260,10 +284,44 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
         return -1;
 
     ctx->force_reload = false;
+    char *old_kernel = ctx->cached->kernel;
     *ctx->cached = *ctx;
+    // ctx->kernel might point to an option string that can go away.
+    ctx->cached->kernel = talloc_strdup(ctx->cached, ctx->kernel);
+    talloc_free(old_kernel);
     return 1;
 }
 
+// Whether the kernel scaler output needs to go through libswscale.
+static bool kscale_needs_conversion(struct mp_sws_context *ctx)
+{
+    return ctx->src.imgfmt != ctx->dst.imgfmt ||
+           ctx->src.colorspace != ctx->dst.colorspace ||
+           ctx->src.colorlevels != ctx->dst.colorlevels ||
+           ctx->brightness != 0 || ctx->contrast != (1 << 16) ||
+           ctx->saturation != (1 << 16);
+}
+
+static void kscale_scale(struct mp_sws_context *ctx, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    if (!kscale_needs_conversion(ctx)) {
+        mp_kscale_scale(ctx->kscale, dst, src);
+        return;
+    }
+
+    struct mp_image *tmp = ctx->kscale_tmp;
+    if (!tmp || tmp->imgfmt != src->imgfmt || tmp->w != dst->w ||
+        tmp->h != dst->h)
+    {
+        talloc_free(tmp);
+        tmp = ctx->kscale_tmp = mp_image_alloc(src->imgfmt, dst->w, dst->h);
+    }
+    mp_kscale_scale(ctx->kscale, tmp, src);
+    sws_scale(ctx->sws, (const uint8_t *const *)tmp->planes, tmp->stride,
+              0, tmp->h, dst->planes, dst->stride);
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -275,6 +333,16 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
     if (dst->imgfmt == IMGFMT_GBRP && !sws_isSupportedOutput(PIX_FMT_GBRP))
         return to_gbrp(dst, src, ctx->flags);
 
+    return mp_sws_scale_slice(ctx, dst, src, 0, src->h);
+}
+
+// Convert only the source rows y to y + h. The caller must pass the slices of
+// a frame in top to bottom order, starting at y = 0, and y must be aligned to
+// the chroma subsampling of src. dst receives the corresponding part of the
+// scaled image once swscale has enough input lines for it.
+int mp_sws_scale_slice(struct mp_sws_context *ctx, struct mp_image *dst,
+                       struct mp_image *src, int y, int h)
+{
     mp_image_params_from_image(&ctx->src, src);
     mp_image_params_from_image(&ctx->dst, dst);
 
@@ -284,8 +352,22 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
-    sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
-              0, src->h, dst->planes, dst->stride);
+    // The kernel scaler always needs the complete frame.
+    if (ctx->kscale) {
+        if (y != 0 || h != src->h)
+            return -1;
+        kscale_scale(ctx, dst, src);
+        return 0;
+    }
+
+    // swscale wants the plane pointers to point to the start of the slice.
+    const uint8_t *planes[MP_MAX_PLANES] = {0};
+    for (int n = 0; n < src->num_planes; n++) {
+        planes[n] = src->planes[n] +
+                    (ptrdiff_t)(y >> src->fmt.ys[n]) * src->stride[n];
+    }
+
+    sws_scale(ctx->sws, planes, src->stride, y, h, dst->planes, dst->stride);
     return 0;
 }
 
@@ -298,6 +380,17 @@ void mp_image_swscale(struct mp_image *dst, struct mp_image *src,
     talloc_free(ctx);
 }
 
+// Like mp_image_swscale() with mp_sws_hq_flags, but use the --sws-kernel
+// scaler if it's set.
+void mp_image_swscale_hq(struct mp_image *dst, struct mp_image *src)
+{
+    struct mp_sws_context *ctx = mp_sws_alloc(NULL);
+    ctx->flags = mp_sws_hq_flags;
+    ctx->kernel = sws_kernel;
+    mp_sws_scale(ctx, dst, src);
+    talloc_free(ctx);
+}
+
 void mp_image_sw_blur_scale(struct mp_image *dst, struct mp_image *src,
                             float gblur)
 {
@@ -21,6 +21,8 @@ bool mp_sws_supported_format(int imgfmt);
 void mp_image_swscale(struct mp_image *dst, struct mp_image *src,
                       int my_sws_flags);
 
+void mp_image_swscale_hq(struct mp_image *dst, struct mp_image *src);
+
 void mp_image_sw_blur_scale(struct mp_image *dst, struct mp_image *src,
                             float gblur);
 
@@ -40,8 +42,17 @@ struct mp_sws_context {
     struct SwsFilter *src_filter, *dst_filter;
     double params[2];
 
+    // If set, scale with this filter from filter_kernels.c (see
+    // kernel_scale.h), and use libswscale only for format conversion.
+    // Not used if the source format isn't supported by the kernel scaler.
+    // The string is copied by mp_sws_reinit().
+    char *kernel;
+
     // Cached context (if any)
     struct SwsContext *sws;
+    // Kernel scaler (if used), and its output if a conversion is needed.
+    struct mp_kscale *kscale;
+    struct mp_image *kscale_tmp;
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
@@ -52,6 +63,8 @@ int mp_sws_reinit(struct mp_sws_context *ctx);
 void mp_sws_set_from_cmdline(struct mp_sws_context *ctx);
 int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
                  struct mp_image *src);
+int mp_sws_scale_slice(struct mp_sws_context *ctx, struct mp_image *dst,
+                       struct mp_image *src, int y, int h);
 
 #endif /* MP_SWS_UTILS_H */
 